@@ -0,0 +1,95 @@
+#include "bench.h"
+#include "gamepad.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#define FRAME_MS 16 // one launcher or emulator frame at ~60 fps
+#define LIST_SIZE 200
+
+static const char *input_names[GAMEPAD_INPUT_MAX] = {
+    "START", "SELECT", "UP", "DOWN", "LEFT", "RIGHT",
+    "A",     "B",      "MENU", "L",  "R"};
+
+/**
+ * @brief Launcher path: gamepad_read() plus key repeat moving a list cursor
+ */
+static void run_launcher(int frames) {
+  gamepad_repeat_state repeat;
+  gamepad_repeat_init(&repeat, NULL);
+
+  int cursor = 0, moves = 0, selects = 0;
+  input_gamepad_state state, last = {0};
+  for (int frame = 0; frame < frames; frame++) {
+    gamepad_read(&state);
+
+    gamepad_repeat_event ev =
+        gamepad_repeat_update(&repeat, &state, frame * FRAME_MS);
+    if (ev.input == GAMEPAD_INPUT_UP || ev.input == GAMEPAD_INPUT_DOWN) {
+      cursor += ev.input == GAMEPAD_INPUT_UP ? -ev.steps : ev.steps;
+      cursor = cursor < 0 ? 0 : cursor >= LIST_SIZE ? LIST_SIZE - 1 : cursor;
+      moves++;
+      printf("  frame %4d: %-5s x%-2d cursor %d\n", frame,
+             input_names[ev.input], ev.steps, cursor);
+    }
+    if (state.values[GAMEPAD_INPUT_A] && !last.values[GAMEPAD_INPUT_A]) {
+      selects++;
+      printf("  frame %4d: A      select %d\n", frame, cursor);
+    }
+    last = state;
+  }
+  printf("launcher: %d moves, %d selects, cursor at %d\n", moves, selects,
+         cursor);
+}
+
+/**
+ * @brief Emulator path: late-latched reads, with edges taken from the bus
+ */
+static void run_emulator(int frames) {
+  gamepad_subscriber_handle sub = gamepad_subscribe(GAMEPAD_INPUT_ALL, 64);
+  if (!sub) {
+    printf("emulator: no bus subscriber slot\n");
+    return;
+  }
+
+  int held_frames[GAMEPAD_INPUT_MAX] = {0};
+  int presses[GAMEPAD_INPUT_MAX] = {0};
+  input_gamepad_state state;
+  for (int frame = 0; frame < frames; frame++) {
+    gamepad_read_latest(&state, true);
+    for (int i = 0; i < GAMEPAD_INPUT_MAX; i++)
+      held_frames[i] += state.values[i];
+
+    gamepad_event ev;
+    while (gamepad_event_wait(sub, &ev, 0)) {
+      presses[ev.input] += ev.pressed;
+      printf("  frame %4d: %-6s %s\n", frame, input_names[ev.input],
+             ev.pressed ? "down" : "up");
+    }
+  }
+  gamepad_unsubscribe(sub);
+
+  printf("emulator: %-6s %8s %8s\n", "button", "presses", "frames");
+  for (int i = 0; i < GAMEPAD_INPUT_MAX; i++) {
+    if (presses[i] || held_frames[i])
+      printf("          %-6s %8d %8d\n", input_names[i], presses[i],
+             held_frames[i]);
+  }
+}
+
+void bench_input(const char *script, int frames) {
+  gamepad_init();
+
+  printf("input replay of %s, %d frames\n", script, frames);
+  if (gamepad_mock_load(script) != 0) {
+    printf("bench_input: script failed to load\n");
+    input_gamepad_terminate();
+    return;
+  }
+  run_launcher(frames);
+
+  // Replay from frame 0 through the emulator path
+  gamepad_mock_load(script);
+  run_emulator(frames);
+
+  input_gamepad_terminate();
+}
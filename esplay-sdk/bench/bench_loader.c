@@ -0,0 +1,84 @@
+#include "bench.h"
+#include "esp_heap_caps.h"
+#include "rom_loader.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+static int64_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief The path used before rom_loader: fseek/ftell, then one fread
+ */
+static size_t load_stdio(const char *path, void *dest) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+  fseek(f, 0, SEEK_END);
+  size_t size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  size_t read = fread(dest, 1, size, f);
+  fclose(f);
+  return read;
+}
+
+static void print_rate(const char *label, size_t bytes, int64_t elapsed_us) {
+  printf("  %-16s %8.2f MB/s  %7.1f ms\n", label,
+         elapsed_us > 0 ? (double)bytes / elapsed_us : 0.0,
+         elapsed_us / 1000.0);
+}
+
+void bench_loader(const char *path) {
+  static const size_t chunks[] = {4096, 8192, 16384, 32768, 65536};
+
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    printf("bench_loader: cannot stat %s\n", path);
+    return;
+  }
+
+  size_t size = st.st_size;
+  uint8_t *dest = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!dest)
+    dest = heap_caps_malloc(size, MALLOC_CAP_8BIT);
+  if (!dest) {
+    printf("bench_loader: no memory for %u bytes\n", (unsigned)size);
+    return;
+  }
+
+  printf("load %s, %u KB\n", path, (unsigned)(size / 1024));
+
+  int64_t start = now_us();
+  size_t loaded = load_stdio(path, dest);
+  print_rate("stdio fread", loaded, now_us() - start);
+
+  for (int i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+    rom_loader_config config = {.chunk_size = chunks[i]};
+    char label[24];
+    snprintf(label, sizeof(label), "loader %2u KB",
+             (unsigned)(chunks[i] / 1024));
+
+    start = now_us();
+    rom_loader_handle ld = rom_loader_start(path, dest, size, &config);
+    if (!ld) {
+      printf("  %-16s failed to start\n", label);
+      continue;
+    }
+    esp_err_t err = rom_loader_wait(ld, UINT32_MAX, &loaded);
+    int64_t elapsed = now_us() - start;
+    rom_loader_close(ld);
+
+    if (err == ESP_OK)
+      print_rate(label, loaded, elapsed);
+    else
+      printf("  %-16s %s\n", label, esp_err_to_name(err));
+  }
+
+  heap_caps_free(dest);
+}
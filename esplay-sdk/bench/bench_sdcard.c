@@ -0,0 +1,310 @@
+#include "bench.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "ff.h"
+#include "sdcard.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SEQ_FILE_SIZE (1024 * 1024)
+#define SEQ_BUFFER_MAX (64 * 1024)
+#define RANDOM_READS 256
+#define RANDOM_READ_SIZE 4096
+#define OPEN_CLOSE_COUNT 200
+#define MAX_RESULTS 24
+
+typedef struct {
+  const char *test;
+  unsigned param; // buffer size or entry count
+  unsigned ops;
+  uint64_t bytes;
+  int64_t elapsed_us;
+} bench_result;
+
+static bench_result results[MAX_RESULTS];
+static int result_count;
+
+static void record(const char *test, unsigned param, unsigned ops,
+                   uint64_t bytes, int64_t elapsed_us) {
+  if (elapsed_us <= 0)
+    elapsed_us = 1;
+
+  printf("  %-12s %6u  %8.2f MB/s  %9.1f op/s  %9.1f ms\n", test, param,
+         (double)bytes / elapsed_us, ops * 1000000.0 / elapsed_us,
+         elapsed_us / 1000.0);
+
+  if (result_count < MAX_RESULTS)
+    results[result_count++] = (bench_result){test, param, ops, bytes,
+                                             elapsed_us};
+}
+
+static void record_failure(const char *test, unsigned param) {
+  printf("  %-12s %6u  failed: %s\n", test, param, strerror(errno));
+}
+
+/**
+ * @brief Write and read back path with one buffer size, unbuffered
+ */
+static void bench_sequential(const char *path, uint8_t *buffer, size_t size) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    record_failure("seq-write", size);
+    return;
+  }
+
+  size_t done = 0;
+  int64_t start = esp_timer_get_time();
+  while (done < SEQ_FILE_SIZE && write(fd, buffer, size) == size)
+    done += size;
+  fsync(fd);
+  close(fd);
+  int64_t elapsed = esp_timer_get_time() - start;
+  if (done < SEQ_FILE_SIZE) {
+    record_failure("seq-write", size);
+    return;
+  }
+  record("seq-write", size, done / size, done, elapsed);
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    record_failure("seq-read", size);
+    return;
+  }
+
+  done = 0;
+  start = esp_timer_get_time();
+  while (done < SEQ_FILE_SIZE && read(fd, buffer, size) == size)
+    done += size;
+  close(fd);
+  elapsed = esp_timer_get_time() - start;
+  if (done < SEQ_FILE_SIZE)
+    record_failure("seq-read", size);
+  else
+    record("seq-read", size, done / size, done, elapsed);
+}
+
+/**
+ * @brief 4 KB reads at scattered aligned offsets, like bank switching does
+ */
+static void bench_random(const char *path, uint8_t *buffer) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    record_failure("rand-read", RANDOM_READ_SIZE);
+    return;
+  }
+
+  const unsigned blocks = SEQ_FILE_SIZE / RANDOM_READ_SIZE;
+  uint32_t seed = 12345;
+  int done = 0;
+  int64_t start = esp_timer_get_time();
+  for (; done < RANDOM_READS; done++) {
+    seed = seed * 1103515245 + 12345;
+    off_t offset = (off_t)((seed >> 8) % blocks) * RANDOM_READ_SIZE;
+    if (lseek(fd, offset, SEEK_SET) != offset ||
+        read(fd, buffer, RANDOM_READ_SIZE) != RANDOM_READ_SIZE)
+      break;
+  }
+  int64_t elapsed = esp_timer_get_time() - start;
+  close(fd);
+
+  if (done < RANDOM_READS)
+    record_failure("rand-read", RANDOM_READ_SIZE);
+  else
+    record("rand-read", RANDOM_READ_SIZE, done,
+           (uint64_t)done * RANDOM_READ_SIZE, elapsed);
+}
+
+static void bench_open_close(const char *path) {
+  int done = 0;
+  int64_t start = esp_timer_get_time();
+  for (; done < OPEN_CLOSE_COUNT; done++) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+      break;
+    close(fd);
+  }
+  int64_t elapsed = esp_timer_get_time() - start;
+
+  if (done < OPEN_CLOSE_COUNT)
+    record_failure("open-close", 0);
+  else
+    record("open-close", 0, done, 0, elapsed);
+}
+
+static int count_entries(const char *path) {
+  DIR *dir = opendir(path);
+  if (!dir)
+    return -1;
+  int count = 0;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL)
+    count += entry->d_name[0] != '.';
+  closedir(dir);
+  return count;
+}
+
+/**
+ * @brief Make sure path holds count empty files. Kept between runs, filling
+ * a 5000 entry folder takes minutes on FAT.
+ */
+static bool populate_dir(const char *path, int count) {
+  if (count_entries(path) == count)
+    return true;
+
+  mkdir(path, 0777);
+  printf("  creating %d files in %s...\n", count, path);
+
+  char name[512];
+  for (int i = 0; i < count; i++) {
+    snprintf(name, sizeof(name), "%s/f%05d.bin", path, i);
+    int fd = open(name, O_WRONLY | O_CREAT, 0666);
+    if (fd < 0)
+      return false;
+    close(fd);
+  }
+  return count_entries(path) == count;
+}
+
+/**
+ * @brief readdir plus a stat per entry, the pattern of a file listing page
+ */
+static void bench_readdir(const char *base, int count) {
+  char path[256];
+  snprintf(path, sizeof(path), "%s/d%d", base, count);
+  if (!populate_dir(path, count)) {
+    record_failure("readdir-stat", count);
+    return;
+  }
+
+  char name[512];
+  struct stat st;
+  int done = 0;
+  int64_t start = esp_timer_get_time();
+  DIR *dir = opendir(path);
+  if (dir) {
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+      if (entry->d_name[0] == '.')
+        continue;
+      snprintf(name, sizeof(name), "%s/%s", path, entry->d_name);
+      if (stat(name, &st) == 0)
+        done++;
+    }
+    closedir(dir);
+  }
+  int64_t elapsed = esp_timer_get_time() - start;
+
+  if (done < count)
+    record_failure("readdir-stat", count);
+  else
+    record("readdir-stat", count, done, 0, elapsed);
+}
+
+/**
+ * @brief Time a cold and a warm f_getfree, then sdcard_get_free_space()
+ *
+ * The mount (from FSINFO) or the sd_space task has usually counted already,
+ * so FatFS's count is dropped first to make the cold pass walk the FAT.
+ */
+static void bench_getfree() {
+  FATFS *fs;
+  DWORD free_clusters;
+  FRESULT res = f_getfree("", &free_clusters, &fs);
+  if (res != FR_OK) {
+    printf("  %-12s %6u  failed: FRESULT %d\n", "f_getfree", 0, res);
+    return;
+  }
+
+  static const char *passes[] = {"getfree-cold", "getfree-warm"};
+  fs->free_clst = 0xFFFFFFFF;
+  for (int i = 0; i < 2; i++) {
+    int64_t start = esp_timer_get_time();
+    res = f_getfree("", &free_clusters, &fs);
+    int64_t elapsed = esp_timer_get_time() - start;
+    if (res == FR_OK)
+      record(passes[i], 0, 1, 0, elapsed);
+    else
+      printf("  %-12s %6u  failed: FRESULT %d\n", passes[i], 0, res);
+  }
+
+  uint32_t total_kb = 0, free_kb = 0;
+  int64_t start = esp_timer_get_time();
+  sdcard_get_free_space(&total_kb, &free_kb);
+  record("free-space", 0, 1, 0, esp_timer_get_time() - start);
+}
+
+/**
+ * @brief Append the results to csv_path, with a header when it is new
+ */
+static void write_csv(const char *csv_path) {
+  struct stat st;
+  bool is_new = stat(csv_path, &st) != 0 || st.st_size == 0;
+
+  FILE *f = fopen(csv_path, "a");
+  if (!f) {
+    printf("bench_sdcard: cannot write %s\n", csv_path);
+    return;
+  }
+
+  if (is_new)
+    fprintf(f, "test,param,ops,bytes,us,mb_per_s,ops_per_s\n");
+  for (int i = 0; i < result_count; i++) {
+    const bench_result *r = &results[i];
+    fprintf(f, "%s,%u,%u,%llu,%lld,%.3f,%.1f\n", r->test, r->param, r->ops,
+            (unsigned long long)r->bytes, (long long)r->elapsed_us,
+            (double)r->bytes / r->elapsed_us,
+            r->ops * 1000000.0 / r->elapsed_us);
+  }
+  fclose(f);
+  printf("results appended to %s\n", csv_path);
+}
+
+void bench_sdcard(const char *dir, const char *csv_path) {
+  static const size_t buffer_sizes[] = {512,  1024,  2048,  4096,
+                                        8192, 16384, 32768, 65536};
+  static const int dir_sizes[] = {100, 1000, 5000};
+
+  if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+    printf("bench_sdcard: cannot create %s\n", dir);
+    return;
+  }
+
+  uint8_t *buffer = heap_caps_malloc(SEQ_BUFFER_MAX, MALLOC_CAP_DMA);
+  if (!buffer) {
+    printf("bench_sdcard: no memory for buffer\n");
+    return;
+  }
+  for (int i = 0; i < SEQ_BUFFER_MAX; i++)
+    buffer[i] = i * 31;
+
+  char path[256];
+  snprintf(path, sizeof(path), "%s/seq.bin", dir);
+  result_count = 0;
+
+  printf("sdcard benchmark in %s, %u KB file\n", dir,
+         (unsigned)(SEQ_FILE_SIZE / 1024));
+  printf("  %-12s %6s  %13s  %14s  %12s\n", "test", "param", "throughput",
+         "rate", "time");
+
+  for (int i = 0; i < sizeof(buffer_sizes) / sizeof(buffer_sizes[0]); i++)
+    bench_sequential(path, buffer, buffer_sizes[i]);
+  bench_random(path, buffer);
+  bench_open_close(path);
+  unlink(path);
+
+  for (int i = 0; i < sizeof(dir_sizes) / sizeof(dir_sizes[0]); i++)
+    bench_readdir(dir, dir_sizes[i]);
+  bench_getfree();
+
+  heap_caps_free(buffer);
+
+  if (csv_path)
+    write_csv(csv_path);
+}
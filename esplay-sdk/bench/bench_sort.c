@@ -0,0 +1,106 @@
+#include "bench.h"
+#include "sdcard_sort.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define NAME_LEN 48
+
+// Common leading words so that many names share long prefixes, like a real
+// ROM folder does
+static const char *const words[] = {
+    "Super",  "the",    "Legend", "of",     "Mega",  "Man",    "Mario",
+    "Bros",   "Kirby",  "Castle", "Dragon", "Quest", "Street", "Fighter",
+    "Sonic",  "Zelda",  "Double", "Dash",   "Final", "Fantasy",
+};
+#define WORD_COUNT (sizeof(words) / sizeof(words[0]))
+
+static uint32_t rng_state;
+
+static uint32_t rng_next() {
+  rng_state = rng_state * 1664525u + 1013904223u;
+  return rng_state >> 8;
+}
+
+static int64_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int qsort_cmp(const void *a, const void *b) {
+  return strcasecmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void make_names(char *storage, char **names, int count) {
+  rng_state = 12345;
+  for (int i = 0; i < count; i++) {
+    char *name = storage + i * NAME_LEN;
+    int len = 0;
+    int word_count = 1 + rng_next() % 3;
+    for (int w = 0; w < word_count; w++)
+      len += snprintf(name + len, NAME_LEN - len, "%s ",
+                      words[rng_next() % WORD_COUNT]);
+    snprintf(name + len, NAME_LEN - len, "%u (USA).nes",
+             (unsigned)(rng_next() % 100000));
+    names[i] = name;
+  }
+}
+
+static double time_sort(char **src, char **work, int count, bool use_qsort) {
+  memcpy(work, src, count * sizeof(char *));
+  int64_t start = now_us();
+  if (use_qsort)
+    qsort(work, count, sizeof(char *), qsort_cmp);
+  else
+    sdcard_sort_names(work, count);
+  return (now_us() - start) / 1000.0;
+}
+
+void bench_sort(int count) {
+  char *storage = malloc((size_t)count * NAME_LEN);
+  char **names = malloc(count * sizeof(char *));
+  char **work = malloc(count * sizeof(char *));
+  if (!storage || !names || !work) {
+    printf("bench_sort: out of memory for %d names\n", count);
+    free(storage);
+    free(names);
+    free(work);
+    return;
+  }
+
+  make_names(storage, names, count);
+  printf("sort %d names      sdcard_sort_names    qsort(3)\n", count);
+
+  for (int order = 0; order < 3; order++) {
+    const char *label = "random";
+    if (order == 1) {
+      sdcard_sort_names(names, count);
+      label = "sorted";
+    } else if (order == 2) {
+      for (int i = 0; i < count / 2; i++) {
+        char *tmp = names[i];
+        names[i] = names[count - 1 - i];
+        names[count - 1 - i] = tmp;
+      }
+      label = "reversed";
+    }
+
+    double ours = time_sort(names, work, count, false);
+    bool ok = true;
+    for (int i = 1; i < count && ok; i++)
+      ok = sdcard_name_cmp(work[i - 1], work[i]) <= 0;
+    double ref = time_sort(names, work, count, true);
+
+    printf("  %-10s %14.2f ms %11.2f ms%s\n", label, ours, ref,
+           ok ? "" : "  ORDER ERROR");
+  }
+
+  free(work);
+  free(names);
+  free(storage);
+}
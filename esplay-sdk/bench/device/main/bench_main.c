@@ -0,0 +1,23 @@
+#include "bench.h"
+#include "sdcard.h"
+#include <stdio.h>
+#include <sys/stat.h>
+
+#define BENCH_DIR "/sd/bench"
+#define BENCH_ROM BENCH_DIR "/rom.bin"
+
+void app_main(void) {
+  if (sdcard_open("/sd") != ESP_OK) {
+    printf("bench: no SD card\n");
+    return;
+  }
+
+  bench_sdcard(BENCH_DIR, BENCH_DIR "/results.csv");
+
+  // Drop any ROM at BENCH_ROM to time the loader on real media too
+  struct stat st;
+  if (stat(BENCH_ROM, &st) == 0)
+    bench_loader(BENCH_ROM);
+
+  bench_sort(2000);
+}
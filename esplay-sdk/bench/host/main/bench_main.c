@@ -0,0 +1,61 @@
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_ROM_SIZE (4 * 1024 * 1024)
+
+/**
+ * @brief ROM for the loader benchmark, BENCH_ROM or a generated 4 MB file
+ */
+static const char *bench_rom_path() {
+  const char *path = getenv("BENCH_ROM");
+  if (path)
+    return path;
+
+  path = "/tmp/esplay_bench_rom.bin";
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return NULL;
+  for (int i = 0; i < BENCH_ROM_SIZE; i++)
+    fputc(i * 31, f);
+  fclose(f);
+  return path;
+}
+
+// Tap A, scroll down with repeat, page with R, then a DOWN+L chord that
+// keeps L held after DOWN is released
+static const char default_script[] = "frame 10: press A for 3 frames\n"
+                                     "frame 30: press DOWN for 60 frames\n"
+                                     "frame 100: press R for 2 frames\n"
+                                     "frame 120: hold DOWN+L\n"
+                                     "frame 180: release DOWN\n"
+                                     "frame 200: release L\n";
+
+/**
+ * @brief Script for the input replay, BENCH_INPUT_SCRIPT or default_script
+ */
+static const char *bench_input_script() {
+  const char *path = getenv("BENCH_INPUT_SCRIPT");
+  if (path)
+    return path;
+
+  path = "/tmp/esplay_bench_input.txt";
+  FILE *f = fopen(path, "w");
+  if (!f)
+    return NULL;
+  fputs(default_script, f);
+  fclose(f);
+  return path;
+}
+
+void app_main(void) {
+  bench_sort(10000);
+
+  const char *rom = bench_rom_path();
+  if (rom)
+    bench_loader(rom);
+
+  const char *script = bench_input_script();
+  if (script)
+    bench_input(script, 240);
+}
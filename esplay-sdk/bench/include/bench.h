@@ -0,0 +1,26 @@
+#pragma once
+
+// Benchmarks for the SD card and ROM loading paths. Each one prints a small
+// table to the console; they run on the device and, where noted, on the
+// linux target through the project in bench/host.
+
+// Sort count generated ROM names presorted, reversed and shuffled, with
+// sdcard_sort_names() and with qsort(3) as a reference. Host and device.
+void bench_sort(int count);
+
+// Load the file at path with the old single fread and with rom_loader at
+// chunk sizes from 4 KB to 64 KB, reporting MB/s. Host and device.
+void bench_loader(const char *path);
+
+// Time the mounted SD card under dir: sequential write and read with 512 B
+// to 64 KB buffers, random 4 KB reads, open/close, readdir plus stat on
+// folders of 100, 1000 and 5000 files, and a cold and warm f_getfree. The
+// folders are kept in dir for later runs. Results are printed and, when
+// csv_path is set, appended to that CSV file. Device only.
+void bench_sdcard(const char *dir, const char *csv_path);
+
+// Replay a gamepad_mock script (see gamepad_mock.c) for frames frames, once
+// through the launcher path (gamepad_read() and key repeat moving a list
+// cursor) and once through the emulator path (gamepad_read_latest() and the
+// event bus), printing every move and edge. Host only.
+void bench_input(const char *script, int frames);
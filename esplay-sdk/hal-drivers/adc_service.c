@@ -0,0 +1,227 @@
+#include "adc_service.h"
+#include "esp_adc/adc_cali.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_log.h"
+#include "gamepad_pins.h"
+#include "power.h"
+#include "scheduler.h"
+#include "sdkconfig.h"
+#include <string.h>
+
+#ifdef CONFIG_ADC_SERVICE_CONTINUOUS
+#include "esp_adc/adc_continuous.h"
+#else
+#include "esp_adc/adc_oneshot.h"
+#endif
+
+static const char *TAG = "adc-service";
+
+#define ADC_CHANNEL_COUNT 8
+#define ADC_ATTEN ADC_ATTEN_DB_12
+
+#ifdef CONFIG_ADC_SERVICE_CONTINUOUS
+#define ADC_SAMPLE_FREQ_HZ SOC_ADC_SAMPLE_FREQ_THRES_LOW
+#define ADC_FRAME_SIZE 1024
+// The driver buffers ~100 ms of conversions between polls
+#define ADC_STORE_SIZE (ADC_FRAME_SIZE * 4)
+#define ADC_POLL_PERIOD_MS 40
+#elif defined(CONFIG_ESPLAY20_HW)
+#define ADC_POLL_PERIOD_MS 20
+#else
+// Battery channel only, sampled as often as the battery monitor reads it
+#define ADC_POLL_PERIOD_MS 500
+#endif
+
+static const adc_channel_t channels[] = {
+    ADC_PIN,
+#ifdef CONFIG_ESPLAY20_HW
+    IO_X,
+    IO_Y,
+#endif
+};
+#define CHANNEL_COUNT (sizeof(channels) / sizeof(channels[0]))
+
+static bool initialized = false;
+static scheduler_job_handle adc_job = NULL;
+static adc_cali_handle_t cali_handle = NULL;
+
+// Filtered values in 1/16 LSB, -1 until the first sample arrives. Single
+// 32-bit stores, so readers never see a torn value.
+static volatile int32_t filtered[ADC_CHANNEL_COUNT];
+
+#ifdef CONFIG_ADC_SERVICE_CONTINUOUS
+static adc_continuous_handle_t adc_handle = NULL;
+#else
+static adc_oneshot_unit_handle_t adc_handle = NULL;
+#endif
+
+/**
+ * @brief Fold a new sample into the per-channel filter (EWMA, alpha 1/4)
+ */
+static void filter_update(adc_channel_t ch, int raw) {
+  int32_t scaled = raw << 4;
+  int32_t prev = filtered[ch];
+  filtered[ch] = (prev < 0) ? scaled : prev + ((scaled - prev) >> 2);
+}
+
+#ifdef CONFIG_ADC_SERVICE_CONTINUOUS
+/**
+ * @brief Scheduler job: drain the frames the DMA collected since last poll
+ */
+static void adc_poll(void *arg) {
+  static uint8_t frame[ADC_FRAME_SIZE];
+  uint32_t sum[ADC_CHANNEL_COUNT];
+  uint32_t count[ADC_CHANNEL_COUNT];
+
+  uint32_t len = 0;
+  while (adc_continuous_read(adc_handle, frame, sizeof(frame), &len, 0) ==
+         ESP_OK) {
+    memset(sum, 0, sizeof(sum));
+    memset(count, 0, sizeof(count));
+
+    // Average each channel over the frame, then feed the filter once
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= len;
+         i += SOC_ADC_DIGI_RESULT_BYTES) {
+      adc_digi_output_data_t *p = (adc_digi_output_data_t *)&frame[i];
+      uint32_t ch = p->type1.channel;
+      if (ch < ADC_CHANNEL_COUNT) {
+        sum[ch] += p->type1.data;
+        count[ch]++;
+      }
+    }
+    for (int ch = 0; ch < ADC_CHANNEL_COUNT; ch++) {
+      if (count[ch])
+        filter_update(ch, sum[ch] / count[ch]);
+    }
+  }
+}
+
+static void adc_backend_init() {
+  adc_continuous_handle_cfg_t handle_config = {
+      .max_store_buf_size = ADC_STORE_SIZE,
+      .conv_frame_size = ADC_FRAME_SIZE,
+  };
+  ESP_ERROR_CHECK(adc_continuous_new_handle(&handle_config, &adc_handle));
+
+  adc_digi_pattern_config_t pattern[CHANNEL_COUNT] = {0};
+  for (int i = 0; i < CHANNEL_COUNT; i++) {
+    pattern[i].atten = ADC_ATTEN;
+    pattern[i].channel = channels[i];
+    pattern[i].unit = ADC_UNIT_1;
+    pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+  }
+
+  adc_continuous_config_t dig_config = {
+      .pattern_num = CHANNEL_COUNT,
+      .adc_pattern = pattern,
+      .sample_freq_hz = ADC_SAMPLE_FREQ_HZ,
+      .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+      .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+  };
+  ESP_ERROR_CHECK(adc_continuous_config(adc_handle, &dig_config));
+}
+
+static void adc_backend_start() {
+  ESP_ERROR_CHECK(adc_continuous_start(adc_handle));
+}
+
+static void adc_backend_deinit() {
+  adc_continuous_stop(adc_handle);
+  adc_continuous_deinit(adc_handle);
+  adc_handle = NULL;
+}
+#else
+static void adc_poll(void *arg) {
+  for (int i = 0; i < CHANNEL_COUNT; i++) {
+    int raw;
+    if (adc_oneshot_read(adc_handle, channels[i], &raw) == ESP_OK)
+      filter_update(channels[i], raw);
+  }
+}
+
+static void adc_backend_init() {
+  adc_oneshot_unit_init_cfg_t init_config = {
+      .unit_id = ADC_UNIT_1,
+      .ulp_mode = ADC_ULP_MODE_DISABLE,
+  };
+  ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config, &adc_handle));
+
+  adc_oneshot_chan_cfg_t chan_config = {
+      .bitwidth = ADC_BITWIDTH_DEFAULT,
+      .atten = ADC_ATTEN,
+  };
+  for (int i = 0; i < CHANNEL_COUNT; i++)
+    ESP_ERROR_CHECK(
+        adc_oneshot_config_channel(adc_handle, channels[i], &chan_config));
+}
+
+static void adc_backend_start() {}
+
+static void adc_backend_deinit() {
+  adc_oneshot_del_unit(adc_handle);
+  adc_handle = NULL;
+}
+#endif
+
+void adc_service_init() {
+  if (initialized)
+    return;
+
+  for (int ch = 0; ch < ADC_CHANNEL_COUNT; ch++)
+    filtered[ch] = -1;
+
+  adc_backend_init();
+
+  // Line fitting is the calibration scheme available on the ESP32
+  adc_cali_line_fitting_config_t cali_config = {
+      .unit_id = ADC_UNIT_1,
+      .atten = ADC_ATTEN,
+      .bitwidth = ADC_BITWIDTH_DEFAULT,
+  };
+  if (adc_cali_create_scheme_line_fitting(&cali_config, &cali_handle) !=
+      ESP_OK) {
+    ESP_LOGW(TAG, "ADC calibration unavailable, using nominal scale");
+    cali_handle = NULL;
+  }
+
+  adc_backend_start();
+  adc_job = scheduler_register("adc", adc_poll, NULL, ADC_POLL_PERIOD_MS,
+                               ADC_POLL_PERIOD_MS);
+
+  initialized = true;
+  ESP_LOGI(TAG, "ADC service started (%d channels)", (int)CHANNEL_COUNT);
+}
+
+void adc_service_deinit() {
+  if (!initialized)
+    return;
+
+  scheduler_unregister(adc_job);
+  adc_job = NULL;
+
+  adc_backend_deinit();
+  if (cali_handle) {
+    adc_cali_delete_scheme_line_fitting(cali_handle);
+    cali_handle = NULL;
+  }
+  initialized = false;
+}
+
+int adc_service_read_raw(adc_channel_t channel) {
+  if (channel >= ADC_CHANNEL_COUNT)
+    return -1;
+  int32_t value = filtered[channel];
+  return (value < 0) ? -1 : (int)(value >> 4);
+}
+
+int adc_service_read_mv(adc_channel_t channel) {
+  int raw = adc_service_read_raw(channel);
+  if (raw < 0)
+    return -1;
+
+  int voltage_mv;
+  if (!cali_handle ||
+      adc_cali_raw_to_voltage(cali_handle, raw, &voltage_mv) != ESP_OK)
+    voltage_mv = (raw * 3300) / 4095;
+  return voltage_mv;
+}
@@ -1,13 +1,18 @@
 #include "gamepad.h"
+#include "adc_service.h"
+#include "gamepad_bus.h"
+#include "gamepad_pins.h"
+#include "power.h"
+#include "scheduler.h"
 #include "driver/gpio.h"
 #include "driver/i2c_master.h"   // v5.x handle-based driver
-#include "esp_adc/adc_oneshot.h" // v5.x oneshot driver
 #include "esp_log.h"
 #include "esp_system.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
 #include "sdkconfig.h"
+#include "soc/gpio_reg.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,11 +28,9 @@ static i2c_port_t i2c_port_num = I2C_PORT;
 // Global Handles for v5.x
 static i2c_master_bus_handle_t bus_handle = NULL;
 static i2c_master_dev_handle_t dev_handle = NULL;
-#ifdef CONFIG_ESPLAY20_HW
-static adc_oneshot_unit_handle_t adc1_handle = NULL;
-#endif
 
-static volatile bool input_task_is_running = false;
+static scheduler_job_handle input_job = NULL;
+static bool profile_held = false;
 static volatile input_gamepad_state gamepad_state;
 static uint8_t debounce_history[GAMEPAD_INPUT_MAX];
 static volatile bool input_gamepad_initialized = false;
@@ -71,20 +74,51 @@ static uint8_t i2c_keypad_read() {
   return data;
 }
 
+// Direct GPIO buttons, sampled from one snapshot of GPIO_IN_REG (GPIO0-31)
+// and GPIO_IN1_REG (GPIO32-39). Masks are folded at compile time.
+#define PIN_IN_MASK(pin) ((pin) < 32 ? (1UL << ((pin) & 31)) : 0)
+#define PIN_IN1_MASK(pin) ((pin) >= 32 ? (1UL << (((pin) - 32) & 31)) : 0)
+#define GPIO_BUTTON(input, pin) {input, PIN_IN_MASK(pin), PIN_IN1_MASK(pin)}
+
+typedef struct {
+  uint8_t input;
+  uint32_t in_mask;
+  uint32_t in1_mask;
+} gpio_button;
+
+static const gpio_button gpio_buttons[] = {
+#ifdef CONFIG_ESPLAY20_HW
+    GPIO_BUTTON(GAMEPAD_INPUT_SELECT, SELECT),
+    GPIO_BUTTON(GAMEPAD_INPUT_START, START),
+    GPIO_BUTTON(GAMEPAD_INPUT_A, A),
+    GPIO_BUTTON(GAMEPAD_INPUT_B, B),
+#endif
+    GPIO_BUTTON(GAMEPAD_INPUT_MENU, MENU),
+    GPIO_BUTTON(GAMEPAD_INPUT_L, L_BTN),
+    GPIO_BUTTON(GAMEPAD_INPUT_R, R_BTN),
+};
+
 /**
- * @brief Read hardware states (ADC and GPIO)
+ * @brief Read hardware states (I2C, ADC and GPIO)
  */
 input_gamepad_state gamepad_input_read_raw() {
   input_gamepad_state state = {0};
 
-#ifdef CONFIG_ESPLAY20_HW
-  int joyX = 0, joyY = 0;
-  // ADC1 Oneshot read - using v5.x handles
-  if (adc1_handle) {
-    adc_oneshot_read(adc1_handle, IO_X, &joyX);
-    adc_oneshot_read(adc1_handle, IO_Y, &joyY);
+  // Read I2C Expanders (Typically Directional Buttons and Action Buttons)
+  uint8_t i2c_data = i2c_keypad_read();
+  for (int i = 0; i < 8; ++i) {
+    state.values[i] = ((i2c_data & (1 << i)) == 0) ? 1 : 0;
   }
 
+#ifdef CONFIG_ESPLAY20_HW
+  // Latest filtered joystick values from the shared ADC service
+  int joyX = adc_service_read_raw(IO_X);
+  int joyY = adc_service_read_raw(IO_Y);
+  if (joyX < 0)
+    joyX = 2048;
+  if (joyY < 0)
+    joyY = 2048;
+
   // Joystick Logic (Adjust thresholds as needed for your specific hardware)
   if (joyX > 3072)
     state.values[GAMEPAD_INPUT_LEFT] = 1;
@@ -95,57 +129,75 @@ input_gamepad_state gamepad_input_read_raw() {
     state.values[GAMEPAD_INPUT_UP] = 1;
   else if (joyY < 1024)
     state.values[GAMEPAD_INPUT_DOWN] = 1;
-
-  state.values[GAMEPAD_INPUT_SELECT] = !(gpio_get_level(SELECT));
-  state.values[GAMEPAD_INPUT_START] = !(gpio_get_level(START));
-  state.values[GAMEPAD_INPUT_A] = !(gpio_get_level(A));
-  state.values[GAMEPAD_INPUT_B] = !(gpio_get_level(B));
 #endif
 
-  // Read I2C Expanders (Typically Directional Buttons and Action Buttons)
-  uint8_t i2c_data = i2c_keypad_read();
-  for (int i = 0; i < 8; ++i) {
-    state.values[i] = ((i2c_data & (1 << i)) == 0) ? 1 : 0;
+  // Direct GPIOs, all active low, taken from a single register snapshot
+  uint32_t in = REG_READ(GPIO_IN_REG);
+  uint32_t in1 = REG_READ(GPIO_IN1_REG);
+  for (int i = 0; i < sizeof(gpio_buttons) / sizeof(gpio_buttons[0]); ++i) {
+    const gpio_button *btn = &gpio_buttons[i];
+    state.values[btn->input] =
+        ((in & btn->in_mask) | (in1 & btn->in1_mask)) ? 0 : 1;
   }
 
-  // Direct GPIOs (System Buttons)
-  state.values[GAMEPAD_INPUT_MENU] = !(gpio_get_level(MENU));
-  state.values[GAMEPAD_INPUT_L] = !(gpio_get_level(L_BTN));
-  state.values[GAMEPAD_INPUT_R] = !(gpio_get_level(R_BTN));
-
   return state;
 }
 
 /**
- * @brief Background task for polling and debouncing
+ * @brief Shift a raw sample into the debounce filter. Caller holds xSemaphore.
+ *
+ * A key changes state after 2 consecutive identical samples. With bypass set,
+ * a key whose history was stable for the whole window takes the new level
+ * immediately; keys that are still bouncing keep the 2-sample filter.
+ * Returns a GAMEPAD_INPUT_BIT() mask of the keys that changed state.
  */
-static void input_task(void *arg) {
-  input_task_is_running = true;
-  memset(debounce_history, 0xFF, sizeof(debounce_history));
+static uint32_t debounce_apply(const input_gamepad_state *raw, bool bypass) {
+  uint32_t changed = 0;
+  for (int i = 0; i < GAMEPAD_INPUT_MAX; ++i) {
+    uint8_t old_state = gamepad_state.values[i];
+    uint8_t prev = debounce_history[i];
+    uint8_t bit = raw->values[i] ? 1 : 0;
+    debounce_history[i] = (prev << 1) | bit;
+    uint8_t val = debounce_history[i] & 0x03;
+
+    if (val == 0x00)
+      gamepad_state.values[i] = 0;
+    else if (val == 0x03)
+      gamepad_state.values[i] = 1;
+    else if (bypass && (prev == 0x00 || prev == 0xFF))
+      gamepad_state.values[i] = bit;
+
+    if (gamepad_state.values[i] != old_state)
+      changed |= GAMEPAD_INPUT_BIT(i);
+  }
+  return changed;
+}
 
-  while (input_task_is_running) {
-    input_gamepad_state raw_state = gamepad_input_read_raw();
-
-    if (xSemaphoreTake(xSemaphore, pdMS_TO_TICKS(10)) == pdTRUE) {
-      for (int i = 0; i < GAMEPAD_INPUT_MAX; ++i) {
-        // Debounce filter: requires 2 consecutive identical samples
-        debounce_history[i] =
-            (debounce_history[i] << 1) | (raw_state.values[i] ? 1 : 0);
-        uint8_t val = debounce_history[i] & 0x03;
-
-        if (val == 0x00)
-          gamepad_state.values[i] = 0;
-        else if (val == 0x03)
-          gamepad_state.values[i] = 1;
-      }
-      xSemaphoreGive(xSemaphore);
-    }
+/**
+ * @brief Periodic scheduler job for polling and debouncing
+ */
+static void input_poll(void *arg) {
+  input_gamepad_state raw_state = gamepad_input_read_raw();
 
-    vTaskDelay(pdMS_TO_TICKS(10));
-  }
+  if (xSemaphoreTake(xSemaphore, pdMS_TO_TICKS(10)) == pdTRUE) {
+    uint32_t changed = debounce_apply(&raw_state, false);
+    input_gamepad_state state = gamepad_state;
+    xSemaphoreGive(xSemaphore);
 
-  input_gamepad_initialized = false;
-  vTaskDelete(NULL);
+    gamepad_bus_publish(changed, &state);
+
+    // Keep the clock up while the user is pressing buttons
+    bool any_pressed = false;
+    for (int i = 0; i < GAMEPAD_INPUT_MAX; ++i)
+      any_pressed |= state.values[i];
+    if (any_pressed != profile_held) {
+      if (any_pressed)
+        power_profile_acquire(POWER_PROFILE_MENU);
+      else
+        power_profile_release(POWER_PROFILE_MENU);
+      profile_held = any_pressed;
+    }
+  }
 }
 
 void gamepad_read(input_gamepad_state *out_state) {
@@ -158,6 +210,22 @@ void gamepad_read(input_gamepad_state *out_state) {
   }
 }
 
+void gamepad_read_latest(input_gamepad_state *out_state, bool bypass_debounce) {
+  if (!input_gamepad_initialized || !out_state)
+    return;
+
+  // Sample outside the lock, the I2C transfer may take a while
+  input_gamepad_state raw_state = gamepad_input_read_raw();
+
+  if (xSemaphoreTake(xSemaphore, portMAX_DELAY) == pdTRUE) {
+    uint32_t changed = debounce_apply(&raw_state, bypass_debounce);
+    *out_state = gamepad_state;
+    xSemaphoreGive(xSemaphore);
+
+    gamepad_bus_publish(changed, out_state);
+  }
+}
+
 void gamepad_init() {
   if (xSemaphore == NULL) {
     xSemaphore = xSemaphoreCreateMutex();
@@ -167,19 +235,8 @@ void gamepad_init() {
     abort();
 
 #ifdef CONFIG_ESPLAY20_HW
-  // 1. Initialize ADC Unit 1
-  adc_oneshot_unit_init_cfg_t init_config1 = {
-      .unit_id = ADC_UNIT_1,
-      .ulp_mode = ADC_ULP_MODE_DISABLE,
-  };
-  ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config1, &adc1_handle));
-
-  adc_oneshot_chan_cfg_t adc_config = {
-      .bitwidth = ADC_BITWIDTH_DEFAULT,
-      .atten = ADC_ATTEN_DB_12,
-  };
-  ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, IO_X, &adc_config));
-  ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, IO_Y, &adc_config));
+  // 1. Joystick axes are sampled by the shared ADC service
+  adc_service_init();
 #endif
 
   // 2. Initialize I2C Bus and Device
@@ -200,18 +257,25 @@ void gamepad_init() {
 
   gpio_config(&btn_config);
 
+  memset(debounce_history, 0xFF, sizeof(debounce_history));
+  gamepad_bus_init();
   input_gamepad_initialized = true;
 
-  // 4. Start Task
-  xTaskCreatePinnedToCore(&input_task, "input_task", 1024 * 3, NULL, 5, NULL,
-                          1);
+  // 4. Poll every 10 ms on the shared scheduler
+  input_job = scheduler_register("gamepad", input_poll, NULL, 10, 10);
 
   ESP_LOGI(TAG, "Gamepad initialized successfully (IDF 5.5.1)");
 }
 
 void input_gamepad_terminate() {
-  input_task_is_running = false;
-  vTaskDelay(pdMS_TO_TICKS(100)); // Allow task to exit
+  scheduler_unregister(input_job);
+  input_job = NULL;
+  input_gamepad_initialized = false;
+
+  if (profile_held) {
+    power_profile_release(POWER_PROFILE_MENU);
+    profile_held = false;
+  }
 
   if (dev_handle) {
     i2c_master_bus_rm_device(dev_handle);
@@ -222,12 +286,7 @@ void input_gamepad_terminate() {
     bus_handle = NULL;
   }
 
-#ifdef CONFIG_ESPLAY20_HW
-  if (adc1_handle) {
-    adc_oneshot_del_unit(adc1_handle);
-    adc1_handle = NULL;
-  }
-#endif
+  gamepad_bus_deinit();
 
   // Note: Don't delete semaphore if other tasks might still call read
   // but in a termination scenario:
@@ -0,0 +1,121 @@
+#include "gamepad_bus.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "hal-gamepad-bus";
+
+#define GAMEPAD_MAX_SUBSCRIBERS 6
+
+struct gamepad_subscriber {
+  bool used;
+  uint32_t input_mask;
+  uint32_t dropped;
+  QueueHandle_t queue;
+};
+
+static struct gamepad_subscriber subscribers[GAMEPAD_MAX_SUBSCRIBERS];
+static SemaphoreHandle_t bus_lock = NULL;
+static StaticSemaphore_t bus_lock_buffer;
+
+void gamepad_bus_init() {
+  if (bus_lock == NULL)
+    bus_lock = xSemaphoreCreateMutexStatic(&bus_lock_buffer);
+}
+
+void gamepad_bus_deinit() {
+  if (bus_lock == NULL)
+    return;
+
+  xSemaphoreTake(bus_lock, portMAX_DELAY);
+  for (int i = 0; i < GAMEPAD_MAX_SUBSCRIBERS; i++) {
+    if (subscribers[i].used) {
+      vQueueDelete(subscribers[i].queue);
+      subscribers[i].used = false;
+    }
+  }
+  xSemaphoreGive(bus_lock);
+}
+
+void gamepad_bus_publish(uint32_t changed, const input_gamepad_state *state) {
+  if (!changed || bus_lock == NULL)
+    return;
+
+  gamepad_event ev = {
+      .timestamp_ms = xTaskGetTickCount() * portTICK_PERIOD_MS,
+  };
+
+  xSemaphoreTake(bus_lock, portMAX_DELAY);
+  for (int i = 0; i < GAMEPAD_MAX_SUBSCRIBERS; i++) {
+    struct gamepad_subscriber *sub = &subscribers[i];
+    uint32_t wanted = changed & sub->input_mask;
+    if (!sub->used || !wanted)
+      continue;
+
+    for (int input = 0; input < GAMEPAD_INPUT_MAX; input++) {
+      if (!(wanted & GAMEPAD_INPUT_BIT(input)))
+        continue;
+      ev.input = input;
+      ev.pressed = state->values[input];
+      // Never block the input path on a slow consumer
+      if (xQueueSend(sub->queue, &ev, 0) != pdTRUE)
+        sub->dropped++;
+    }
+  }
+  xSemaphoreGive(bus_lock);
+}
+
+gamepad_subscriber_handle gamepad_subscribe(uint32_t input_mask,
+                                            int queue_depth) {
+  if (bus_lock == NULL || queue_depth <= 0)
+    return NULL;
+
+  gamepad_subscriber_handle handle = NULL;
+  xSemaphoreTake(bus_lock, portMAX_DELAY);
+  for (int i = 0; i < GAMEPAD_MAX_SUBSCRIBERS; i++) {
+    if (subscribers[i].used)
+      continue;
+
+    QueueHandle_t queue = xQueueCreate(queue_depth, sizeof(gamepad_event));
+    if (!queue)
+      break;
+    subscribers[i] = (struct gamepad_subscriber){
+        .used = true,
+        .input_mask = input_mask,
+        .queue = queue,
+    };
+    handle = &subscribers[i];
+    break;
+  }
+  xSemaphoreGive(bus_lock);
+
+  if (!handle)
+    ESP_LOGW(TAG, "No free subscriber slot");
+  return handle;
+}
+
+void gamepad_unsubscribe(gamepad_subscriber_handle sub) {
+  if (!sub || bus_lock == NULL)
+    return;
+
+  xSemaphoreTake(bus_lock, portMAX_DELAY);
+  if (sub->used) {
+    if (sub->dropped)
+      ESP_LOGD(TAG, "Subscriber dropped %lu events",
+               (unsigned long)sub->dropped);
+    vQueueDelete(sub->queue);
+    sub->used = false;
+  }
+  xSemaphoreGive(bus_lock);
+}
+
+bool gamepad_event_wait(gamepad_subscriber_handle sub, gamepad_event *out,
+                        uint32_t timeout_ms) {
+  if (!sub || !out)
+    return false;
+
+  TickType_t ticks =
+      (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+  return xQueueReceive(sub->queue, out, ticks) == pdTRUE;
+}
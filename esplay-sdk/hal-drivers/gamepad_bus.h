@@ -0,0 +1,9 @@
+#pragma once
+
+#include "gamepad.h"
+
+// Internal to hal-drivers: the gamepad backends call these to feed the
+// subscriber bus declared in gamepad.h.
+void gamepad_bus_init();
+void gamepad_bus_deinit();
+void gamepad_bus_publish(uint32_t changed, const input_gamepad_state *state);
@@ -0,0 +1,221 @@
+/**
+ * @file gamepad_mock.c
+ * @brief Scripted gamepad backend for host (linux target) builds.
+ *
+ * Replaces gamepad.c when building for the linux target. Button state is
+ * driven by a timeline script instead of hardware, one frame per call to
+ * gamepad_read() or gamepad_read_latest(). Script lines:
+ *
+ *   # comment
+ *   frame 30: press A for 3 frames
+ *   frame 40: press UP+L for 10 frames
+ *   frame 90: hold START+L
+ *   frame 120: release START    # L stays held
+ *   frame 150: release L
+ *
+ * A line that does not parse, or an unknown button name, fails the whole
+ * load. The script is loaded by gamepad_init() from $GAMEPAD_MOCK_SCRIPT, or
+ * explicitly with gamepad_mock_load().
+ */
+
+#include "esp_log.h"
+#include "gamepad.h"
+#include "gamepad_bus.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "hal-gamepad-mock";
+
+#define FRAME_FOREVER UINT32_MAX
+
+typedef struct {
+  uint32_t start;
+  uint32_t end; // exclusive
+  uint32_t mask;
+} mock_event;
+
+static const char *input_names[GAMEPAD_INPUT_MAX] = {
+    "START", "SELECT", "UP", "DOWN", "LEFT", "RIGHT",
+    "A",     "B",      "MENU", "L",  "R"};
+
+static mock_event *events = NULL;
+static int event_count = 0;
+static int event_capacity = 0;
+static uint32_t current_frame = 0;
+static input_gamepad_state last_state;
+static bool input_gamepad_initialized = false;
+
+/**
+ * @brief Button list like "UP+L" to a mask, 0 if any name is unknown
+ */
+static uint32_t parse_buttons(char *list, int line_no) {
+  uint32_t mask = 0;
+  for (char *tok = strtok(list, "+"); tok; tok = strtok(NULL, "+")) {
+    int i;
+    for (i = 0; i < GAMEPAD_INPUT_MAX; i++) {
+      if (strcasecmp(tok, input_names[i]) == 0) {
+        mask |= 1UL << i;
+        break;
+      }
+    }
+    if (i == GAMEPAD_INPUT_MAX) {
+      ESP_LOGE(TAG, "line %d: unknown button '%s'", line_no, tok);
+      return 0;
+    }
+  }
+  return mask;
+}
+
+static bool add_event(uint32_t start, uint32_t end, uint32_t mask) {
+  if (event_count == event_capacity) {
+    int capacity = event_capacity ? event_capacity * 2 : 16;
+    mock_event *grown = realloc(events, capacity * sizeof(mock_event));
+    if (!grown)
+      return false;
+    events = grown;
+    event_capacity = capacity;
+  }
+  events[event_count++] = (mock_event){start, end, mask};
+  return true;
+}
+
+static bool parse_line(char *line, int line_no) {
+  char *hash = strchr(line, '#');
+  if (hash)
+    *hash = '\0';
+
+  char *p = line;
+  while (isspace((unsigned char)*p))
+    p++;
+  if (*p == '\0')
+    return true;
+
+  unsigned frame, count = 0;
+  char verb[16], buttons[64];
+  int n = sscanf(p, "frame %u: %15s %63s for %u", &frame, verb, buttons,
+                 &count);
+  if (n < 3) {
+    ESP_LOGE(TAG, "line %d: expected 'frame N: <verb> <buttons>'", line_no);
+    return false;
+  }
+
+  uint32_t mask = parse_buttons(buttons, line_no);
+  if (!mask)
+    return false;
+
+  if (strcasecmp(verb, "press") == 0) {
+    if (n < 4 || count == 0) {
+      ESP_LOGE(TAG, "line %d: press needs 'for N frames'", line_no);
+      return false;
+    }
+    return add_event(frame, frame + count, mask);
+  } else if (strcasecmp(verb, "hold") == 0) {
+    return add_event(frame, FRAME_FOREVER, mask);
+  } else if (strcasecmp(verb, "release") == 0) {
+    // End the holds that include these buttons; the rest of a multi-button
+    // hold carries on as a new hold from this frame
+    int count = event_count;
+    for (int i = 0; i < count; i++) {
+      uint32_t held = events[i].mask;
+      if (events[i].end != FRAME_FOREVER || !(held & mask) ||
+          events[i].start > frame)
+        continue;
+      events[i].end = frame;
+      if ((held & ~mask) && !add_event(frame, FRAME_FOREVER, held & ~mask))
+        return false;
+    }
+    return true;
+  }
+
+  ESP_LOGE(TAG, "line %d: unknown verb '%s'", line_no, verb);
+  return false;
+}
+
+int gamepad_mock_load(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    ESP_LOGE(TAG, "Cannot open script %s", path);
+    return -1;
+  }
+
+  event_count = 0;
+  current_frame = 0;
+  last_state = (input_gamepad_state){0};
+
+  char line[256];
+  int line_no = 0;
+  int ret = 0;
+  while (fgets(line, sizeof(line), f)) {
+    if (!parse_line(line, ++line_no)) {
+      ret = -1;
+      break;
+    }
+  }
+  fclose(f);
+
+  if (ret != 0) {
+    // A half-loaded script would run a different scenario than written
+    event_count = 0;
+    ESP_LOGE(TAG, "Script %s not loaded", path);
+    return ret;
+  }
+  ESP_LOGI(TAG, "Loaded %d events from %s", event_count, path);
+  return 0;
+}
+
+uint32_t gamepad_mock_frame() { return current_frame; }
+
+input_gamepad_state gamepad_input_read_raw() {
+  input_gamepad_state state = {0};
+  uint32_t mask = 0;
+
+  for (int i = 0; i < event_count; i++) {
+    if (events[i].start <= current_frame && current_frame < events[i].end)
+      mask |= events[i].mask;
+  }
+  for (int i = 0; i < GAMEPAD_INPUT_MAX; i++)
+    state.values[i] = (mask >> i) & 1;
+
+  return state;
+}
+
+void gamepad_read(input_gamepad_state *out_state) {
+  if (!input_gamepad_initialized || !out_state)
+    return;
+
+  input_gamepad_state state = gamepad_input_read_raw();
+  current_frame++;
+
+  uint32_t changed = 0;
+  for (int i = 0; i < GAMEPAD_INPUT_MAX; i++) {
+    if (state.values[i] != last_state.values[i])
+      changed |= GAMEPAD_INPUT_BIT(i);
+  }
+  last_state = state;
+  *out_state = state;
+  gamepad_bus_publish(changed, &state);
+}
+
+void gamepad_read_latest(input_gamepad_state *out_state, bool bypass_debounce) {
+  gamepad_read(out_state);
+}
+
+void gamepad_init() {
+  const char *script = getenv("GAMEPAD_MOCK_SCRIPT");
+  if (script)
+    gamepad_mock_load(script);
+
+  gamepad_bus_init();
+  input_gamepad_initialized = true;
+  ESP_LOGI(TAG, "Mock gamepad initialized");
+}
+
+void input_gamepad_terminate() {
+  input_gamepad_initialized = false;
+  gamepad_bus_deinit();
+  free(events);
+  events = NULL;
+  event_count = event_capacity = 0;
+}
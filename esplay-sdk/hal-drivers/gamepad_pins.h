@@ -0,0 +1,26 @@
+#pragma once
+
+#include "sdkconfig.h"
+
+// Internal to hal-drivers: board GPIOs and ADC channels of the buttons and
+// joystick, and the I2C keypad expander behind the D-pad and A/B.
+#ifdef CONFIG_ESPLAY20_HW
+#define A 32
+#define B 33
+#define START 36
+#define SELECT 0
+#define IO_Y ADC_CHANNEL_7
+#define IO_X ADC_CHANNEL_6
+#endif
+
+// Same GPIOs on every board
+#define L_BTN 36
+#define R_BTN 34
+#define MENU 35
+
+// I2C Configuration
+#define I2C_SDA 21
+#define I2C_SCL 22
+#define I2C_MASTER_FREQUENCY 100000
+#define I2C_PORT I2C_NUM_0
+#define I2C_ADDR_KEYPAD 0x20
@@ -0,0 +1,86 @@
+#include "gamepad.h"
+#include <string.h>
+
+// Upper bound of steps reported by one update, so a stalled caller does not
+// get a burst of hundreds of moves when it finally polls again.
+#define MAX_STEPS_PER_UPDATE 8
+
+static const gamepad_repeat_config default_config = {
+    .initial_delay_ms = 400,
+    .repeat_interval_ms = 150,
+    .min_interval_ms = 30,
+    .accel_percent = 85,
+    .page_size = 8,
+};
+
+static const int directions[] = {GAMEPAD_INPUT_UP, GAMEPAD_INPUT_DOWN,
+                                 GAMEPAD_INPUT_LEFT, GAMEPAD_INPUT_RIGHT};
+
+void gamepad_repeat_init(gamepad_repeat_state *rep,
+                         const gamepad_repeat_config *config) {
+  memset(rep, 0, sizeof(*rep));
+  rep->config = config ? *config : default_config;
+  if (rep->config.page_size == 0)
+    rep->config.page_size = 1;
+  rep->held = -1;
+}
+
+gamepad_repeat_event gamepad_repeat_update(gamepad_repeat_state *rep,
+                                           const input_gamepad_state *state,
+                                           uint32_t now_ms) {
+  gamepad_repeat_event ev = {.input = -1, .steps = 0};
+  bool l = state->values[GAMEPAD_INPUT_L];
+  bool r = state->values[GAMEPAD_INPUT_R];
+
+  int key = -1;
+  for (int i = 0; i < sizeof(directions) / sizeof(directions[0]); i++) {
+    if (state->values[directions[i]]) {
+      key = directions[i];
+      break;
+    }
+  }
+
+  // L/R alone page up/down, L/R held with a direction page in that direction
+  if (key < 0 && l != r)
+    key = l ? GAMEPAD_INPUT_UP : GAMEPAD_INPUT_DOWN;
+  int multiplier = (l || r) ? rep->config.page_size : 1;
+
+  // New press or chord change: fire once and arm the initial delay
+  if (key != rep->held || multiplier != rep->multiplier) {
+    rep->held = key;
+    rep->multiplier = multiplier;
+    if (key < 0)
+      return ev;
+
+    rep->interval_ms = rep->config.repeat_interval_ms;
+    rep->next_ms = now_ms + rep->config.initial_delay_ms;
+    ev.input = key;
+    ev.steps = multiplier;
+    return ev;
+  }
+
+  if (key < 0)
+    return ev;
+
+  int steps = 0;
+  while ((int32_t)(now_ms - rep->next_ms) >= 0) {
+    if (++steps >= MAX_STEPS_PER_UPDATE) {
+      rep->next_ms = now_ms + rep->interval_ms;
+      break;
+    }
+    rep->next_ms += rep->interval_ms;
+
+    // Accelerate while held
+    uint32_t next = rep->interval_ms * rep->config.accel_percent / 100;
+    rep->interval_ms =
+        (next < rep->config.min_interval_ms) ? rep->config.min_interval_ms : next;
+    if (rep->interval_ms == 0)
+      rep->interval_ms = 1;
+  }
+
+  if (steps > 0) {
+    ev.input = key;
+    ev.steps = steps * multiplier;
+  }
+  return ev;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "hal/adc_types.h"
+
+// Owner of ADC_UNIT_1. Samples the joystick axes (ESPLAY20) and the battery
+// channel from the shared scheduler; readers get the latest filtered value
+// without touching the hardware. Safe to call init more than once.
+void adc_service_init();
+void adc_service_deinit();
+
+// Latest filtered raw conversion (0-4095), or -1 if not sampled yet
+int adc_service_read_raw(adc_channel_t channel);
+
+// Latest filtered value converted to millivolts at the ADC pin, or -1
+int adc_service_read_mv(adc_channel_t channel);
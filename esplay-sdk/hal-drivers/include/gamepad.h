@@ -4,27 +4,6 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-#ifdef CONFIG_ESPLAY20_HW
-#define A 32
-#define B 33
-#define START 36
-#define SELECT 0
-#define IO_Y ADC1_CHANNEL_7
-#define IO_X ADC1_CHANNEL_6
-#define MENU 13
-#endif
-
-#define L_BTN 36
-#define R_BTN 34
-#define MENU 35
-
-// I2C Configuration
-#define I2C_SDA 21
-#define I2C_SCL 22
-#define I2C_MASTER_FREQUENCY 100000
-#define I2C_PORT I2C_NUM_0
-#define I2C_ADDR_KEYPAD 0x20
-
 enum {
   GAMEPAD_INPUT_START = 0,
   GAMEPAD_INPUT_SELECT,
@@ -45,9 +24,72 @@ typedef struct {
   uint8_t values[GAMEPAD_INPUT_MAX];
 } input_gamepad_state;
 
+#define GAMEPAD_INPUT_BIT(input) (1UL << (input))
+#define GAMEPAD_INPUT_ALL (GAMEPAD_INPUT_BIT(GAMEPAD_INPUT_MAX) - 1)
+
+// Debounced press/release edge delivered to bus subscribers
+typedef struct {
+  uint8_t input;
+  uint8_t pressed;
+  uint32_t timestamp_ms;
+} gamepad_event;
+
+typedef struct gamepad_subscriber *gamepad_subscriber_handle;
+
+// Key repeat: hold a direction for initial_delay_ms and it starts repeating
+// every repeat_interval_ms, shrinking by accel_percent per repeat down to
+// min_interval_ms. Holding L or R multiplies every step by page_size; L or R
+// alone jumps a page up or down.
+typedef struct {
+  uint16_t initial_delay_ms;
+  uint16_t repeat_interval_ms;
+  uint16_t min_interval_ms;
+  uint8_t accel_percent;
+  uint8_t page_size;
+} gamepad_repeat_config;
+
+typedef struct {
+  gamepad_repeat_config config;
+  int held;
+  int multiplier;
+  uint32_t next_ms;
+  uint32_t interval_ms;
+} gamepad_repeat_state;
+
+typedef struct {
+  int input; // GAMEPAD_INPUT_UP/DOWN/LEFT/RIGHT, or -1 when nothing fired
+  int steps; // how many positions to move
+} gamepad_repeat_event;
+
 void gamepad_init();
 void input_gamepad_terminate();
 void gamepad_read(input_gamepad_state *out_state);
+// Sample the hardware now instead of returning the last polled state. Call
+// right before running an emulator frame; bypass_debounce lets keys that
+// were stable take a new level without waiting for a second sample.
+void gamepad_read_latest(input_gamepad_state *out_state, bool bypass_debounce);
 input_gamepad_state gamepad_input_read_raw();
 
+// Event bus: each subscriber gets its own queue of edges for the inputs in
+// input_mask (GAMEPAD_INPUT_BIT() values). Events are dropped, not blocked
+// on, when a queue is full. Available after gamepad_init(); returns NULL
+// when all slots are taken. Pass UINT32_MAX to wait forever.
+gamepad_subscriber_handle gamepad_subscribe(uint32_t input_mask,
+                                            int queue_depth);
+void gamepad_unsubscribe(gamepad_subscriber_handle sub);
+bool gamepad_event_wait(gamepad_subscriber_handle sub, gamepad_event *out,
+                        uint32_t timeout_ms);
+
+// Host builds only, defined by gamepad_mock.c: load a timeline script (see
+// there for the format) and query the frame the mock is at. Returns 0 on
+// success.
+int gamepad_mock_load(const char *path);
+uint32_t gamepad_mock_frame();
+
+void gamepad_repeat_init(gamepad_repeat_state *rep,
+                         const gamepad_repeat_config *config);
+gamepad_repeat_event gamepad_repeat_update(gamepad_repeat_state *rep,
+                                           const input_gamepad_state *state,
+                                           uint32_t now_ms);
+
 #endif
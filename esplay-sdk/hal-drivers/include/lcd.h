@@ -27,5 +27,10 @@ void lcd_init(esp_lcd_panel_handle_t *panel);
  */
 void lcd_set_brightness(uint8_t brightness);
 
+/**
+ * @brief Get the LCD brightness last set, 0 to 100.
+ */
+uint8_t lcd_get_brightness(void);
+
 void lcd_draw(esp_lcd_panel_handle_t panel, int x1, int y1, int x2, int y2,
               uint8_t *px_map);
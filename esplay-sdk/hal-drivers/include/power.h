@@ -1,26 +1,46 @@
-#pragma once
-
-// STATUS LED
-#define LED1 13
-
-// POWER
-#define USB_PLUG_PIN 32
-#define CHRG_STATE_PIN 33
-#define ADC_PIN ADC_CHANNEL_3
-
-typedef enum { NO_CHRG = 0, CHARGING, FULL_CHARGED } charging_state;
-
-typedef struct {
-  int millivolts;
-  int percentage;
-  charging_state state;
-} battery_state;
-
-void system_sleep();
-void esplay_system_init();
-void battery_level_init();
-void battery_level_read(battery_state *out_state);
-void battery_level_force_voltage(float volts);
-void battery_monitor_enabled_set(int value);
-charging_state getChargeStatus();
-void system_led_set(int state);
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// STATUS LED
+#define LED1 13
+
+// POWER
+#define USB_PLUG_PIN 32
+#define CHRG_STATE_PIN 33
+#define ADC_PIN ADC_CHANNEL_3
+
+typedef enum { NO_CHRG = 0, CHARGING, FULL_CHARGED } charging_state;
+
+// Power profiles built on esp_pm locks. Each held profile pins the CPU/APB
+// clock and light-sleep permission it needs; with nothing held the system
+// scales down to the minimum clock and may enter automatic light sleep.
+typedef enum {
+  POWER_PROFILE_IDLE = 0,  // launcher idle: no locks
+  POWER_PROFILE_MENU,      // UI navigation: CPU at max, no light sleep
+  POWER_PROFILE_TRANSFER,  // file transfer: APB at max, no light sleep
+  POWER_PROFILE_EMULATION, // emulation: CPU at max, no light sleep
+  POWER_PROFILE_MAX
+} power_profile;
+
+typedef struct {
+  int millivolts;
+  int percentage;
+  charging_state state;
+  int minutes_remaining; // -1 while charging or not yet estimated, at most 24 h
+} battery_state;
+
+void system_sleep();
+bool system_light_sleep(uint32_t timeout_ms);
+void esplay_system_init();
+void battery_level_init();
+void battery_level_read(battery_state *out_state);
+void battery_level_force_voltage(float volts);
+void power_profiles_init();
+void power_profile_acquire(power_profile profile);
+void power_profile_release(power_profile profile);
+int power_profile_active(power_profile profile);
+void battery_monitor_enabled_set(int value);
+charging_state getChargeStatus();
+void system_led_set(int state);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include "esp_err.h"
+
+// Power telemetry recorder. Samples battery millivolts, percentage, charge
+// state, CPU frequency and backlight level into a RAM ring buffer and
+// appends them to a CSV file on SD in large batches every few minutes.
+// Each session starts with a "# session <tag>" line, so discharge profiles
+// can be split per emulator.
+
+// Start recording, appending to path. Fails if already running. Tags are
+// cut at 64 characters.
+esp_err_t power_telemetry_start(const char *path, const char *tag);
+
+// Stop recording and write out whatever is still buffered
+void power_telemetry_stop();
+
+// Ask for a batch write now, e.g. before a deliberate shutdown
+void power_telemetry_flush();
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Compressed ROM support. A ".gz" file, or the first file in a ".zip"
+// (stored or deflated), is inflated straight into the destination buffer:
+// the output buffer doubles as the inflate window, input is read in small
+// chunks, and no temp file is written. The CRC32 in the archive is checked.
+
+// True for names ending in .zip or .gz
+bool rom_archive_is_archive(const char *path);
+
+// Uncompressed size of the ROM inside the archive, 0 on error
+size_t rom_archive_get_size(const char *path);
+
+// CRC32 of the ROM inside, as recorded in the archive. No data is inflated.
+bool rom_archive_get_crc(const char *path, uint32_t *crc);
+
+// Name of the ROM inside a .zip, from the central directory. Without an
+// archive comment that is three small reads. False for other files.
+bool rom_archive_get_name(const char *path, char *name, size_t name_size);
+
+// Inflate the ROM into dest. Returns the bytes written, 0 on error or if
+// dest_size is too small.
+size_t rom_archive_load(const char *path, void *dest, size_t dest_size);
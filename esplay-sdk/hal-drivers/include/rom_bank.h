@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Demand-paged ROM access for ROMs larger than the memory an emulator can
+// spare. The ROM is split into fixed-size banks; a bounded LRU cache of
+// banks lives in PSRAM and misses are filled from SD. With prefetch on, a
+// miss on bank N also queues bank N + 1 on a background task.
+//
+// A bank returned by rom_bank_acquire() stays pinned, and its pointer
+// valid, until the matching rom_bank_release(). Mappers should release the
+// old bank when switching, so at most a few banks are pinned at once.
+typedef struct rom_bank_cache *rom_bank_handle;
+
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t prefetches;     // banks loaded ahead of use
+  uint32_t prefetch_hits;  // prefetched banks that were then used
+  uint32_t evictions;
+} rom_bank_stats;
+
+// bank_size must be a power of two, cache_size is rounded down to whole
+// banks (at least two)
+rom_bank_handle rom_bank_open(const char *path, size_t bank_size,
+                              size_t cache_size, bool prefetch);
+void rom_bank_close(rom_bank_handle cache);
+
+// NULL if the bank is out of range, cannot be read, or all slots are pinned
+const uint8_t *rom_bank_acquire(rom_bank_handle cache, uint32_t bank);
+void rom_bank_release(rom_bank_handle cache, uint32_t bank);
+
+// Copy len bytes from offset, crossing banks as needed. Returns bytes read.
+size_t rom_bank_read(rom_bank_handle cache, uint32_t offset, void *dest,
+                     size_t len);
+
+size_t rom_bank_rom_size(rom_bank_handle cache);
+uint32_t rom_bank_count(rom_bank_handle cache);
+void rom_bank_get_stats(rom_bank_handle cache, rom_bank_stats *out);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Persistent per-folder ROM index. Each system folder gets a ".catalog"
+// file holding the sorted names, sizes and optional CRCs of its ROMs, so a
+// list screen opens without a stat per file, a sort or hashing the ROMs
+// again.
+//
+// FAT does not update directory timestamps, so every open checks freshness
+// with one FatFS pass over the folder (names, sizes and dates, no stat per
+// file). The catalog is only rebuilt when the fingerprint of those entries
+// differs, and a CRC is only kept while the size and date of its file are
+// unchanged, so a replaced ROM of the same size is hashed again.
+//
+// A .zip is listed when the file inside has the extension. Each zip is only
+// opened to check that when it is new or its size or date changed; the
+// answer is kept in the catalog, including for zips that are not listed.
+typedef struct rom_catalog *rom_catalog_handle;
+
+typedef struct {
+  const char *name; // valid until the catalog is refreshed or closed
+  uint32_t size;
+  uint32_t crc; // 0 until set with rom_catalog_set_crc()
+} rom_catalog_entry;
+
+// Load, and refresh if needed, the catalog of files in path ending with
+// extension. Returns NULL if the folder cannot be read.
+rom_catalog_handle rom_catalog_open(const char *path, const char *extension);
+
+// Rescan the folder, rewriting the catalog when its content changed.
+// Returns true if the entries changed.
+bool rom_catalog_refresh(rom_catalog_handle cat, bool force);
+
+int rom_catalog_count(rom_catalog_handle cat);
+bool rom_catalog_get(rom_catalog_handle cat, int index, rom_catalog_entry *out);
+
+// Record a CRC computed by the caller, written back on close
+void rom_catalog_set_crc(rom_catalog_handle cat, int index, uint32_t crc);
+
+void rom_catalog_close(rom_catalog_handle cat);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdint.h>
+
+// ROM identity for per-game settings, save mapping and database lookups:
+// the CRC32 of the uncompressed ROM. A lowest priority task hashes new or
+// changed ROMs ahead of time and keeps the results in one small index file,
+// keyed by a 64-bit hash and the length of the path together with the file
+// size and FAT date, so the CRC is normally known before a game starts.
+// Archives are not inflated, the CRC recorded in the .zip or .gz is used.
+
+// Load the index from index_path (created on first save) and start the
+// indexer task. The card must be mounted.
+esp_err_t rom_hash_init(const char *index_path);
+
+// Queue a folder: every file matching extension (see sdcard_files_get())
+// that the index does not know in its current size and date is hashed.
+// Entries of files no longer in the folder are dropped.
+esp_err_t rom_hash_index_folder(const char *path, const char *extension);
+
+// CRC32 of the ROM at path, from the index when the size and date still
+// match, otherwise hashed on the spot and remembered.
+esp_err_t rom_hash_get(const char *path, uint32_t *crc);
+
+// Stop the indexer after the current read and save the index. Call before
+// a game needs the card to itself.
+void rom_hash_stop();
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Asynchronous ROM loader. A reader task fills two internal DMA-capable
+// bounce buffers from SD in large sector-aligned reads while a copier task
+// moves the previous chunk into the destination (usually PSRAM), so SD
+// transfers and PSRAM copies overlap. Progress is reported per chunk.
+// sdcard_copy_file_to_memory() uses it for destinations the SD driver
+// cannot DMA into directly.
+typedef struct rom_loader *rom_loader_handle;
+
+// Called from the copier task after each chunk
+typedef void (*rom_loader_progress_fn)(size_t done, size_t total, void *arg);
+
+typedef struct {
+  size_t chunk_size; // multiple of 4 KB, 0 for CONFIG_ROM_LOADER_CHUNK_KB
+  rom_loader_progress_fn progress;
+  void *progress_arg;
+} rom_loader_config;
+
+// Start loading up to dest_size bytes of path into dest. config may be NULL.
+rom_loader_handle rom_loader_start(const char *path, void *dest,
+                                   size_t dest_size,
+                                   const rom_loader_config *config);
+
+// ESP_ERR_TIMEOUT while still loading, then ESP_OK, ESP_FAIL on a read
+// error or ESP_ERR_NOT_FINISHED if cancelled. loaded may be NULL.
+esp_err_t rom_loader_wait(rom_loader_handle loader, uint32_t timeout_ms,
+                          size_t *loaded);
+
+// Ask the tasks to stop after the chunk in flight, does not wait
+void rom_loader_cancel(rom_loader_handle loader);
+
+// Cancel if still running, wait for the tasks and free the loader
+void rom_loader_close(rom_loader_handle loader);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Background save writer. save_service_request() copies the buffer and
+// returns at once; a low-priority task writes it to "<path>.tmp", fsyncs it,
+// renames it to "<path>.new" and then over path. Requests for a path that is
+// still pending replace the pending copy, so a burst of saves becomes a
+// single write.
+
+esp_err_t save_service_init();
+
+// Queue a save of size bytes to path. The data is copied before returning.
+// When every pending slot holds another path, the oldest is written first
+// and this blocks until it has been taken.
+esp_err_t save_service_request(const char *path, const void *data,
+                               size_t size);
+
+// Write everything pending now and wait for it, e.g. before leaving a game
+// or sleeping. ESP_ERR_TIMEOUT if writes are still running after timeout_ms.
+esp_err_t save_service_flush(uint32_t timeout_ms);
+
+// Call before loading a save. A queued or running save of path is written
+// first. Then a complete "<path>.new" left by power loss is renamed in and
+// a partly written "<path>.tmp" dropped, unless another task is writing
+// path right now. Returns true if path exists after.
+bool save_service_recover(const char *path);
+
+// The same write path, synchronous, for files written in pieces (indexes,
+// catalogs, atlases). save_service_open() creates "<path>.tmp", waiting
+// while another task writes path; save_service_commit() fsyncs, closes and
+// swaps it in, or removes it and returns false if any write failed.
+// save_service_abort() closes and removes it. Neither needs
+// save_service_init().
+FILE *save_service_open(const char *path);
+bool save_service_commit(FILE *f, const char *path);
+void save_service_abort(FILE *f, const char *path);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// Shared periodic-work scheduler. Jobs run on a single task, dispatched from
+// a timer wheel with one slot per RTOS tick; the task sleeps until the next
+// job is due. A job that starts more than deadline_ms after it was due counts
+// as a deadline miss. Jobs must not block for long, they delay each other.
+typedef void (*scheduler_job_fn)(void *arg);
+typedef struct scheduler_job *scheduler_job_handle;
+
+// First run is one period after registration. Returns NULL when full.
+scheduler_job_handle scheduler_register(const char *name, scheduler_job_fn fn,
+                                        void *arg, uint32_t period_ms,
+                                        uint32_t deadline_ms);
+
+// Waits for the job to finish if it is running right now
+void scheduler_unregister(scheduler_job_handle job);
+
+uint32_t scheduler_deadline_misses(scheduler_job_handle job);
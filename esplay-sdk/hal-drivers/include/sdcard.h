@@ -1,12 +1,50 @@
 #pragma once
 
 #include "esp_err.h"
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
-void sdcard_get_free_space(uint32_t *tot, uint32_t *free);
+typedef struct {
+  int width;    // bus width in bits
+  int freq_khz; // bus clock
+  float write_mbps;
+  float read_mbps;
+  esp_err_t err; // mount or I/O failure for this mode
+} sdcard_benchmark_result;
+
+// Streaming directory listing of the files ending with extension, plus
+// "<extension>.gz" archives and .zip archives holding such a file. Entries
+// come in directory order, in batches, so a list can start showing them
+// before the scan is done. Names stay valid until sdcard_dir_close().
+// Every .zip is opened to check the file inside; rom_catalog keeps that
+// answer between listings.
+typedef struct sdcard_dir *sdcard_dir_handle;
+
+sdcard_dir_handle sdcard_dir_open(const char *path, const char *extension);
+// Fill names with up to max entries. Returns 0 once the folder is exhausted.
+int sdcard_dir_next(sdcard_dir_handle dir, const char **names, int max);
+void sdcard_dir_close(sdcard_dir_handle dir);
+
+// Total and free space in KiB. The first count after mounting runs in the
+// background; until it is done this returns false, leaving tot and free
+// alone. After that FatFS keeps the count and the call is cheap.
+bool sdcard_get_free_space(uint32_t *tot, uint32_t *free);
+// Sorted list of all matching files, in one block freed by sdcard_files_free
 int sdcard_files_get(const char *path, const char *extension, char ***filesOut);
 void sdcard_files_free(char **files, int count);
-esp_err_t sdcard_open();
+esp_err_t sdcard_open(const char *base_path);
 esp_err_t sdcard_close();
+// For .zip/.gz archives these return and load the uncompressed ROM
 size_t sdcard_get_filesize(const char *path);
 size_t sdcard_copy_file_to_memory(const char *path, void *ptr);
-char *sdcard_create_savefile_path(const char *base_path, const char *fileName);
\ No newline at end of file
+char *sdcard_create_savefile_path(const char *base_path, const char *fileName);
+
+// Remount in every bus clock, and with CONFIG_SDCARD_BUS_WIDTH_4 every bus
+// width, and time sequential writes and reads of a size_kb file on each.
+// Restores the configured mode. Returns the number of results filled in.
+// Every remount invalidates open files, so call it with nothing open on the
+// card: stop rom_hash and wait for save_service first.
+int sdcard_benchmark(size_t size_kb, sdcard_benchmark_result *results,
+                     int max_results);
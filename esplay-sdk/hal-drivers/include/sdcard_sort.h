@@ -0,0 +1,10 @@
+#pragma once
+
+// Case-insensitive ASCII compare used for every sorted listing
+int sdcard_name_cmp(const char *a, const char *b);
+
+// Sort names in sdcard_name_cmp() order. Each name is case folded once
+// into a prefix key, then sorted with an iterative merge sort, so the cost
+// stays O(n log n) for presorted or reversed input and the stack use is
+// constant. Falls back to an in-place heap sort if no memory is available.
+void sdcard_sort_names(char **names, int count);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "esp_err.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Packed boxart thumbnails, one atlas file per system. The file holds a
+// header, an index sorted by name hash, then fixed-size slots of pre-scaled
+// RGB565 pixels stored big-endian, the byte order the panel takes. Slots
+// start on 512 byte boundaries, so a thumbnail is one seek and one
+// sector-aligned read straight into the caller's buffer. Wrap that buffer
+// in an lv_image_dsc_t with LV_COLOR_FORMAT_RGB565_SWAPPED, or send it to
+// the panel as is.
+//
+// Entries are keyed by ROM name without folders or extension: "Game.nes",
+// "Game.nes.gz", "Game.zip" and "roms/nes/Game" share a thumbnail.
+typedef struct thumb_atlas *thumb_atlas_handle;
+
+// Load the header and index. The file stays open until thumb_atlas_close().
+thumb_atlas_handle thumb_atlas_open(const char *path);
+
+// Thumbnail dimensions; returns the bytes thumb_atlas_read() writes
+size_t thumb_atlas_image_size(thumb_atlas_handle atlas, uint16_t *width,
+                              uint16_t *height);
+
+bool thumb_atlas_contains(thumb_atlas_handle atlas, const char *rom_name);
+
+// Read the thumbnail of rom_name into pixels. For the fastest path pass a
+// 4-byte aligned buffer in internal RAM, which the SD driver can DMA into.
+bool thumb_atlas_read(thumb_atlas_handle atlas, const char *rom_name,
+                      void *pixels);
+
+void thumb_atlas_close(thumb_atlas_handle atlas);
+
+// Building an atlas, on the device or in a host build: reserve room for up
+// to capacity entries, add native-endian RGB565 images of any size (scaled
+// to width x height with a box filter), then finish to write the index.
+typedef struct thumb_atlas_writer *thumb_atlas_writer_handle;
+
+thumb_atlas_writer_handle thumb_atlas_create(const char *path, uint16_t width,
+                                             uint16_t height,
+                                             uint32_t capacity);
+esp_err_t thumb_atlas_add(thumb_atlas_writer_handle writer,
+                          const char *rom_name, const uint16_t *pixels,
+                          uint16_t src_width, uint16_t src_height);
+// Write the index and replace path. Frees the writer either way.
+esp_err_t thumb_atlas_finish(thumb_atlas_writer_handle writer);
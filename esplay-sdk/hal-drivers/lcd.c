@@ -12,6 +12,7 @@
 #include "esp_lcd_panel_io.h"
 #include "esp_lcd_panel_ops.h"
 #include "esp_lcd_panel_vendor.h"
+#include "esp_pm.h"
 #include "freertos/FreeRTOS.h"
 #include <stdio.h>
 
@@ -30,6 +31,14 @@
 #define LCD_LEDC_DUTY_RES LEDC_TIMER_10_BIT // 10-bit resolution (0-1023)
 #define LCD_LEDC_FREQ_HZ 5000               // 5kHz frequency
 
+static uint8_t current_brightness = 100;
+
+#ifdef CONFIG_PM_ENABLE
+// The backlight PWM stops in light sleep, so hold it off while lit
+static esp_pm_lock_handle_t backlight_pm_lock = NULL;
+static bool backlight_pm_held = false;
+#endif
+
 /**
  * @brief Initialize the LCD backlight using PWM (LEDC).
  */
@@ -39,7 +48,13 @@ static void backlight_init() {
                                     .timer_num = LCD_LEDC_TIMER,
                                     .duty_resolution = LCD_LEDC_DUTY_RES,
                                     .freq_hz = LCD_LEDC_FREQ_HZ,
-                                    .clk_cfg = LEDC_AUTO_CLK};
+#ifdef CONFIG_PM_ENABLE
+                                    // APB scales with DFS, RC_FAST does not
+                                    .clk_cfg = LEDC_USE_RC_FAST_CLK
+#else
+                                    .clk_cfg = LEDC_AUTO_CLK
+#endif
+  };
   ESP_ERROR_CHECK(ledc_timer_config(&ledc_timer));
 
   // Prepare and then apply the LEDC PWM channel configuration
@@ -52,6 +67,13 @@ static void backlight_init() {
       .duty = 1023, // Start at max brightness (10-bit max)
       .hpoint = 0};
   ESP_ERROR_CHECK(ledc_channel_config(&ledc_channel));
+
+#ifdef CONFIG_PM_ENABLE
+  ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "backlight",
+                                     &backlight_pm_lock));
+  esp_pm_lock_acquire(backlight_pm_lock);
+  backlight_pm_held = true;
+#endif
 }
 
 /**
@@ -61,14 +83,28 @@ static void backlight_init() {
 void lcd_set_brightness(uint8_t brightness) {
   if (brightness > 100)
     brightness = 100;
+  current_brightness = brightness;
 
   // Map 0-100% to 0-1023 (for 10-bit resolution)
   uint32_t duty = (brightness * 1023) / 100;
 
   ESP_ERROR_CHECK(ledc_set_duty(LCD_LEDC_MODE, LCD_LEDC_CHANNEL, duty));
   ESP_ERROR_CHECK(ledc_update_duty(LCD_LEDC_MODE, LCD_LEDC_CHANNEL));
+
+#ifdef CONFIG_PM_ENABLE
+  // Light sleep is only allowed once the backlight is off
+  if (backlight_pm_lock && (brightness > 0) != backlight_pm_held) {
+    if (brightness > 0)
+      esp_pm_lock_acquire(backlight_pm_lock);
+    else
+      esp_pm_lock_release(backlight_pm_lock);
+    backlight_pm_held = brightness > 0;
+  }
+#endif
 }
 
+uint8_t lcd_get_brightness(void) { return current_brightness; }
+
 /**
  * @brief Initialize the LCD display.
  *
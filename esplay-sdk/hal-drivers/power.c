@@ -1,210 +1,470 @@
-#include "power.h"
-#include "driver/gpio.h"
-#include "driver/rtc_io.h"
-#include "esp_event.h"
-#include "esp_log.h"
-#include "esp_sleep.h"
-#include "esp_system.h"
-#include "freertos/FreeRTOS.h"
-#include "gamepad.h"
-
-// New ADC headers for 5.x
-#include "esp_adc/adc_cali.h"
-#include "esp_adc/adc_cali_scheme.h"
-#include "esp_adc/adc_oneshot.h"
-
-static const char *TAG = "power";
-
-static bool input_battery_initialized = false;
-static float adc_value = 0.0f;
-static float forced_adc_value = 0.0f;
-static bool battery_monitor_enabled = true;
-
-// ADC Handles for 5.5.1
-static adc_oneshot_unit_handle_t adc1_handle;
-static adc_cali_handle_t adc1_cali_handle = NULL;
-static bool do_calibration = false;
-
-/**
- * @brief Enter Deep Sleep. Wakes up on MENU button press.
- */
-void system_sleep() {
-  ESP_LOGI(TAG, "Preparing for deep sleep...");
-
-  input_gamepad_state joystick;
-  gamepad_read(&joystick);
-
-  // Wait for MENU button release to avoid immediate wakeup
-  while (joystick.values[GAMEPAD_INPUT_MENU]) {
-    vTaskDelay(pdMS_TO_TICKS(10));
-    gamepad_read(&joystick);
-  }
-
-  // Configure wakeup: MENU button pulls to GND (0)
-  // Ensure MENU is defined as an RTC_GPIO in your config
-  esp_err_t err = esp_sleep_enable_ext0_wakeup(MENU, 0);
-
-  if (err != ESP_OK) {
-    ESP_LOGE(TAG, "Sleep config failed: %s", esp_err_to_name(err));
-    return;
-  }
-
-  vTaskDelay(pdMS_TO_TICKS(100));
-  esp_deep_sleep_start();
-}
-
-void esplay_system_init() {
-  if (rtc_gpio_is_valid_gpio(MENU)) {
-    rtc_gpio_deinit(MENU);
-  }
-}
-
-void system_led_set(int state) { gpio_set_level(LED1, state); }
-
-charging_state getChargeStatus() {
-  // Active low logic usually applies to hardware status pins
-  if (!gpio_get_level(USB_PLUG_PIN))
-    return NO_CHRG;
-
-  if (!gpio_get_level(CHRG_STATE_PIN))
-    return CHARGING;
-
-  return FULL_CHARGED;
-}
-
-static void battery_monitor_task(void *pvParameters) {
-  bool led_state = false;
-  int fullCtr = 0;
-  bool fixFull = false;
-
-  while (true) {
-    if (battery_monitor_enabled) {
-      battery_state battery;
-      battery_level_read(&battery);
-
-      // Low battery warning: Blink LED
-      if (battery.percentage < 2) {
-        led_state = !led_state;
-        system_led_set(led_state);
-      } else {
-        charging_state chrg = getChargeStatus();
-
-        if (chrg == FULL_CHARGED || fixFull) {
-          fullCtr++;
-          system_led_set(0);
-          if (fullCtr >= 32)
-            fixFull = true;
-        } else if (chrg == CHARGING) {
-          fullCtr = 0;
-          fixFull = false;
-          system_led_set(1); // Solid LED while charging
-        } else               // NO_CHRG
-        {
-          system_led_set(0);
-        }
-      }
-    }
-    vTaskDelay(pdMS_TO_TICKS(500));
-  }
-}
-
-void battery_level_init() {
-  // 1. GPIO Configuration
-  gpio_config_t power_io_cfg = {
-      .pin_bit_mask = (1ULL << LED1),
-      .mode = GPIO_MODE_OUTPUT,
-      .pull_up_en = 0,
-      .pull_down_en = 0,
-  };
-  gpio_config(&power_io_cfg);
-
-  gpio_config_t input_io_cfg = {
-      .pin_bit_mask = (1ULL << USB_PLUG_PIN) | (1ULL << CHRG_STATE_PIN),
-      .mode = GPIO_MODE_INPUT,
-      .pull_up_en = 1,
-      .pull_down_en = 0,
-  };
-  gpio_config(&input_io_cfg);
-
-  // 2. ADC Oneshot Unit Init
-  adc_oneshot_unit_init_cfg_t init_config1 = {
-      .unit_id = ADC_UNIT_1,
-      .ulp_mode = ADC_ULP_MODE_DISABLE,
-  };
-  ESP_ERROR_CHECK(adc_oneshot_new_unit(&init_config1, &adc1_handle));
-
-  // 3. ADC Channel Config
-  adc_oneshot_chan_cfg_t config = {
-      .bitwidth = ADC_BITWIDTH_DEFAULT,
-      .atten = ADC_ATTEN_DB_12,
-  };
-  ESP_ERROR_CHECK(adc_oneshot_config_channel(adc1_handle, ADC_PIN, &config));
-
-  // 4. Calibration Init (Line Fitting is standard for ESP32/ESP32-S3)
-  adc_cali_line_fitting_config_t cali_config = {
-      .unit_id = ADC_UNIT_1,
-      .atten = ADC_ATTEN_DB_12,
-      .bitwidth = ADC_BITWIDTH_DEFAULT,
-  };
-
-  if (adc_cali_create_scheme_line_fitting(&cali_config, &adc1_cali_handle) ==
-      ESP_OK) {
-    do_calibration = true;
-  }
-
-  input_battery_initialized = true;
-  xTaskCreatePinnedToCore(&battery_monitor_task, "bat_task", 2560, NULL, 5,
-                          NULL, 1);
-}
-
-void battery_level_read(battery_state *out_state) {
-  if (!input_battery_initialized)
-    return;
-
-  const int sampleCount = 8;
-  int total_voltage_mv = 0;
-
-  for (int i = 0; i < sampleCount; ++i) {
-    int raw, voltage_mv;
-    adc_oneshot_read(adc1_handle, ADC_PIN, &raw);
-
-    if (do_calibration) {
-      adc_cali_raw_to_voltage(adc1_cali_handle, raw, &voltage_mv);
-    } else {
-      voltage_mv = (raw * 3300) / 4095;
-    }
-    total_voltage_mv += voltage_mv;
-  }
-
-  float adcSample = (total_voltage_mv / (float)sampleCount) / 1000.0f;
-
-  // Rolling average filter
-  if (adc_value == 0.0f)
-    adc_value = adcSample;
-  else
-    adc_value = (adc_value * 0.9f) + (adcSample * 0.1f);
-
-  // Voltage Divider Calculation (Assuming R1=100k, R2=100k)
-  const float Vs =
-      (forced_adc_value > 0.0f) ? forced_adc_value : (adc_value * 2.0f);
-
-  const float FullVoltage = 4.1f;
-  const float EmptyVoltage = 3.4f;
-
-  out_state->millivolts = (int)(Vs * 1000);
-  out_state->percentage =
-      (int)((Vs - EmptyVoltage) / (FullVoltage - EmptyVoltage) * 100.0f);
-
-  if (out_state->percentage > 100)
-    out_state->percentage = 100;
-  if (out_state->percentage < 0)
-    out_state->percentage = 0;
-
-  out_state->state = getChargeStatus();
-}
-
-void battery_level_force_voltage(float volts) { forced_adc_value = volts; }
-
-void battery_monitor_enabled_set(int value) {
-  battery_monitor_enabled = (bool)value;
-}
+#include "power.h"
+#include "adc_service.h"
+#include "driver/gpio.h"
+#include "driver/rtc_io.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "gamepad.h"
+#include "gamepad_pins.h"
+#include "scheduler.h"
+
+static const char *TAG = "power";
+
+static bool input_battery_initialized = false;
+static float adc_value = 0.0f;
+static float forced_adc_value = 0.0f;
+static bool battery_monitor_enabled = true;
+
+// Published by battery_monitor_job, copied out by battery_level_read()
+static battery_state cached_battery;
+static portMUX_TYPE battery_lock = portMUX_INITIALIZER_UNLOCKED;
+
+typedef struct {
+  bool cpu_max;
+  bool apb_max;
+  bool no_light_sleep;
+} profile_locks;
+
+static const profile_locks profiles[POWER_PROFILE_MAX] = {
+    [POWER_PROFILE_IDLE] = {false, false, false},
+    [POWER_PROFILE_MENU] = {true, false, true},
+    [POWER_PROFILE_TRANSFER] = {false, true, true},
+    [POWER_PROFILE_EMULATION] = {true, false, true},
+};
+
+static int profile_refs[POWER_PROFILE_MAX];
+static portMUX_TYPE profile_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#ifdef CONFIG_PM_ENABLE
+static esp_pm_lock_handle_t cpu_lock = NULL;
+static esp_pm_lock_handle_t apb_lock = NULL;
+static esp_pm_lock_handle_t sleep_lock = NULL;
+#endif
+
+/**
+ * @brief Configure DFS / automatic light sleep and create the profile locks
+ */
+void power_profiles_init() {
+#ifdef CONFIG_PM_ENABLE
+  if (cpu_lock)
+    return;
+
+  esp_pm_config_t pm_config = {
+      .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+      .min_freq_mhz = CONFIG_XTAL_FREQ,
+#ifdef CONFIG_FREERTOS_USE_TICKLESS_IDLE
+      .light_sleep_enable = true,
+#endif
+  };
+  esp_err_t err = esp_pm_configure(&pm_config);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "esp_pm_configure failed: %s", esp_err_to_name(err));
+    return;
+  }
+
+  ESP_ERROR_CHECK(
+      esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "profile_cpu", &cpu_lock));
+  ESP_ERROR_CHECK(
+      esp_pm_lock_create(ESP_PM_APB_FREQ_MAX, 0, "profile_apb", &apb_lock));
+  ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "profile_sleep",
+                                     &sleep_lock));
+#else
+  ESP_LOGW(TAG, "CONFIG_PM_ENABLE is off, power profiles are no-ops");
+#endif
+}
+
+/**
+ * @brief Take a reference on a profile. Safe to nest and to call from any task.
+ */
+void power_profile_acquire(power_profile profile) {
+  if (profile >= POWER_PROFILE_MAX)
+    return;
+
+  taskENTER_CRITICAL(&profile_lock);
+  profile_refs[profile]++;
+  taskEXIT_CRITICAL(&profile_lock);
+
+#ifdef CONFIG_PM_ENABLE
+  // esp_pm locks are counted, so each reference maps to one acquire
+  if (!cpu_lock)
+    return;
+  const profile_locks *locks = &profiles[profile];
+  if (locks->cpu_max)
+    esp_pm_lock_acquire(cpu_lock);
+  if (locks->apb_max)
+    esp_pm_lock_acquire(apb_lock);
+  if (locks->no_light_sleep)
+    esp_pm_lock_acquire(sleep_lock);
+#endif
+}
+
+void power_profile_release(power_profile profile) {
+  if (profile >= POWER_PROFILE_MAX)
+    return;
+
+  taskENTER_CRITICAL(&profile_lock);
+  bool held = profile_refs[profile] > 0;
+  if (held)
+    profile_refs[profile]--;
+  taskEXIT_CRITICAL(&profile_lock);
+
+  if (!held)
+    return;
+
+#ifdef CONFIG_PM_ENABLE
+  if (!cpu_lock)
+    return;
+  const profile_locks *locks = &profiles[profile];
+  if (locks->cpu_max)
+    esp_pm_lock_release(cpu_lock);
+  if (locks->apb_max)
+    esp_pm_lock_release(apb_lock);
+  if (locks->no_light_sleep)
+    esp_pm_lock_release(sleep_lock);
+#endif
+}
+
+int power_profile_active(power_profile profile) {
+  return (profile < POWER_PROFILE_MAX) ? profile_refs[profile] : 0;
+}
+
+/**
+ * @brief Enter Deep Sleep. Wakes up on MENU button press.
+ */
+void system_sleep() {
+  ESP_LOGI(TAG, "Preparing for deep sleep...");
+
+  // Subscribe before sampling so a release in between is not missed
+  gamepad_subscriber_handle menu_events =
+      gamepad_subscribe(GAMEPAD_INPUT_BIT(GAMEPAD_INPUT_MENU), 4);
+
+  input_gamepad_state joystick;
+  gamepad_read(&joystick);
+  bool menu_down = joystick.values[GAMEPAD_INPUT_MENU];
+
+  // Wait for MENU button release to avoid immediate wakeup
+  while (menu_down) {
+    gamepad_event ev;
+    if (menu_events) {
+      if (gamepad_event_wait(menu_events, &ev, UINT32_MAX))
+        menu_down = ev.pressed;
+    } else {
+      vTaskDelay(pdMS_TO_TICKS(10));
+      gamepad_read(&joystick);
+      menu_down = joystick.values[GAMEPAD_INPUT_MENU];
+    }
+  }
+  gamepad_unsubscribe(menu_events);
+
+  // Configure wakeup: MENU button pulls to GND (0)
+  // Ensure MENU is defined as an RTC_GPIO in your config
+  esp_err_t err = esp_sleep_enable_ext0_wakeup(MENU, 0);
+
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "Sleep config failed: %s", esp_err_to_name(err));
+    return;
+  }
+
+  vTaskDelay(pdMS_TO_TICKS(100));
+  esp_deep_sleep_start();
+}
+
+// Buttons wired straight to GPIOs can wake the chip from light sleep. The
+// D-pad and action buttons behind the I2C expander have no interrupt line,
+// so they are polled on a short timer wakeup instead.
+static const gpio_num_t wake_pins[] = {
+#ifdef CONFIG_ESPLAY20_HW
+    A, B, START, SELECT,
+#endif
+    MENU, L_BTN, R_BTN,
+};
+
+#define LIGHT_SLEEP_POLL_MS 100
+
+/**
+ * @brief Light sleep until a button is pressed or timeout_ms has passed.
+ *
+ * Returns true when woken by input. RAM, peripherals and the display
+ * contents are kept, so the caller resumes exactly where it stopped.
+ */
+bool system_light_sleep(uint32_t timeout_ms) {
+  for (int i = 0; i < sizeof(wake_pins) / sizeof(wake_pins[0]); ++i)
+    gpio_wakeup_enable(wake_pins[i], GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+
+  bool woken = false;
+  uint32_t slept_ms = 0;
+  while (!woken && slept_ms < timeout_ms) {
+    uint32_t step = timeout_ms - slept_ms;
+    if (step > LIGHT_SLEEP_POLL_MS)
+      step = LIGHT_SLEEP_POLL_MS;
+
+    esp_sleep_enable_timer_wakeup((uint64_t)step * 1000);
+    esp_light_sleep_start();
+
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO) {
+      woken = true;
+    } else {
+      slept_ms += step;
+      input_gamepad_state state = gamepad_input_read_raw();
+      for (int i = 0; i < GAMEPAD_INPUT_MAX; ++i)
+        woken |= state.values[i];
+    }
+  }
+
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+  for (int i = 0; i < sizeof(wake_pins) / sizeof(wake_pins[0]); ++i)
+    gpio_wakeup_disable(wake_pins[i]);
+
+  return woken;
+}
+
+void esplay_system_init() {
+  if (rtc_gpio_is_valid_gpio(MENU)) {
+    rtc_gpio_deinit(MENU);
+  }
+}
+
+void system_led_set(int state) { gpio_set_level(LED1, state); }
+
+charging_state getChargeStatus() {
+  // Active low logic usually applies to hardware status pins
+  if (!gpio_get_level(USB_PLUG_PIN))
+    return NO_CHRG;
+
+  if (!gpio_get_level(CHRG_STATE_PIN))
+    return CHARGING;
+
+  return FULL_CHARGED;
+}
+
+// Resting (open circuit) voltage to state of charge for a 1S Li-ion cell.
+// Full and empty points match the previous linear 3.4 V - 4.1 V mapping.
+typedef struct {
+  int millivolts;
+  int percentage;
+} soc_point;
+
+static const soc_point soc_curve[] = {
+    {3400, 0},  {3550, 3},  {3650, 8},  {3700, 15}, {3740, 25}, {3780, 38},
+    {3820, 50}, {3870, 62}, {3930, 73}, {4000, 85}, {4060, 95}, {4100, 100},
+};
+#define SOC_POINTS (sizeof(soc_curve) / sizeof(soc_curve[0]))
+
+// Expected current draw, used to compensate voltage sag in the SoC estimate.
+// Emulation and Wi-Fi transfers count as heavy load, see battery_load_now().
+typedef enum { BATTERY_LOAD_IDLE = 0, BATTERY_LOAD_HEAVY } battery_load;
+
+// Voltage sag under load, added back before the curve lookup
+static const int load_sag_mv[] = {
+    [BATTERY_LOAD_IDLE] = 20,
+    [BATTERY_LOAD_HEAVY] = 80,
+};
+static battery_load current_load = BATTERY_LOAD_IDLE;
+
+// Drain rate estimator: SoC is compared over fixed windows and the rate in
+// percent per minute is folded into an EWMA. Only battery_monitor_job and
+// battery_level_init() touch this state.
+#define DRAIN_WINDOW_MS (60 * 1000)
+#define DRAIN_EWMA_ALPHA 0.25f
+// Windows averaged before an estimate is reported, the first one is noisy
+#define DRAIN_MIN_WINDOWS 3
+// Cap for a nearly flat discharge, where SoC / rate runs into the millions
+#define DRAIN_MAX_MINUTES (24 * 60)
+static float drain_window_soc = -1.0f;
+static TickType_t drain_window_start = 0;
+static float drain_rate = 0.0f; // percent per minute, 0 while unknown
+static int drain_windows = 0;
+
+static float soc_from_millivolts(int mv) {
+  if (mv <= soc_curve[0].millivolts)
+    return 0.0f;
+  if (mv >= soc_curve[SOC_POINTS - 1].millivolts)
+    return 100.0f;
+
+  int i = 1;
+  while (mv > soc_curve[i].millivolts)
+    i++;
+  const soc_point *lo = &soc_curve[i - 1];
+  const soc_point *hi = &soc_curve[i];
+  return lo->percentage + (float)(mv - lo->millivolts) *
+                              (hi->percentage - lo->percentage) /
+                              (hi->millivolts - lo->millivolts);
+}
+
+static int drain_estimate_update(float soc, charging_state state) {
+  TickType_t now = xTaskGetTickCount();
+
+  // Charging invalidates the discharge history
+  if (state != NO_CHRG) {
+    drain_window_soc = -1.0f;
+    drain_rate = 0.0f;
+    drain_windows = 0;
+    return -1;
+  }
+
+  if (drain_window_soc < 0.0f) {
+    drain_window_soc = soc;
+    drain_window_start = now;
+  } else if ((now - drain_window_start) >= pdMS_TO_TICKS(DRAIN_WINDOW_MS)) {
+    float minutes = (now - drain_window_start) * portTICK_PERIOD_MS / 60000.0f;
+    float rate = (drain_window_soc - soc) / minutes;
+    if (rate < 0.0f)
+      rate = 0.0f;
+
+    drain_rate = (drain_rate == 0.0f)
+                     ? rate
+                     : drain_rate + DRAIN_EWMA_ALPHA * (rate - drain_rate);
+    drain_window_soc = soc;
+    drain_window_start = now;
+    drain_windows++;
+  }
+
+  if (drain_windows < DRAIN_MIN_WINDOWS)
+    return -1;
+  if (drain_rate * DRAIN_MAX_MINUTES <= soc)
+    return DRAIN_MAX_MINUTES;
+  return (int)(soc / drain_rate);
+}
+
+/**
+ * @brief Load implied by the held power profiles
+ */
+static battery_load battery_load_now() {
+  return (power_profile_active(POWER_PROFILE_EMULATION) ||
+          power_profile_active(POWER_PROFILE_TRANSFER))
+             ? BATTERY_LOAD_HEAVY
+             : BATTERY_LOAD_IDLE;
+}
+
+/**
+ * @brief Sample the battery and publish the result to the cache.
+ * Only called from battery_level_init() and battery_monitor_job.
+ */
+static void battery_level_sample(battery_state *out_state) {
+  // Already averaged by the ADC service, this never blocks
+  int voltage_mv = adc_service_read_mv(ADC_PIN);
+  if (voltage_mv < 0)
+    voltage_mv = 0;
+
+  float adcSample = voltage_mv / 1000.0f;
+
+  // Rolling average filter
+  if (adc_value == 0.0f)
+    adc_value = adcSample;
+  else
+    adc_value = (adc_value * 0.9f) + (adcSample * 0.1f);
+
+  // Voltage Divider Calculation (Assuming R1=100k, R2=100k)
+  const float Vs =
+      (forced_adc_value > 0.0f) ? forced_adc_value : (adc_value * 2.0f);
+
+  out_state->millivolts = (int)(Vs * 1000);
+  out_state->state = getChargeStatus();
+
+  // The compensated SoC steps when the load changes, restart the window
+  battery_load load = battery_load_now();
+  if (load != current_load) {
+    current_load = load;
+    drain_window_soc = -1.0f;
+  }
+
+  float soc =
+      soc_from_millivolts(out_state->millivolts + load_sag_mv[current_load]);
+  out_state->percentage = (int)(soc + 0.5f);
+  out_state->minutes_remaining = drain_estimate_update(soc, out_state->state);
+
+  taskENTER_CRITICAL(&battery_lock);
+  cached_battery = *out_state;
+  taskEXIT_CRITICAL(&battery_lock);
+}
+
+/**
+ * @brief Scheduler job: sample the battery and drive the status LED
+ */
+static void battery_monitor_job(void *arg) {
+  static bool led_state = false;
+  static int fullCtr = 0;
+  static bool fixFull = false;
+
+  battery_state battery;
+  battery_level_sample(&battery);
+
+  if (!battery_monitor_enabled)
+    return;
+
+  // Low battery warning: Blink LED
+  if (battery.percentage < 2) {
+    led_state = !led_state;
+    system_led_set(led_state);
+  } else {
+    charging_state chrg = getChargeStatus();
+
+    if (chrg == FULL_CHARGED || fixFull) {
+      fullCtr++;
+      system_led_set(0);
+      if (fullCtr >= 32)
+        fixFull = true;
+    } else if (chrg == CHARGING) {
+      fullCtr = 0;
+      fixFull = false;
+      system_led_set(1); // Solid LED while charging
+    } else               // NO_CHRG
+    {
+      system_led_set(0);
+    }
+  }
+}
+
+void battery_level_init() {
+  // 1. GPIO Configuration
+  gpio_config_t power_io_cfg = {
+      .pin_bit_mask = (1ULL << LED1),
+      .mode = GPIO_MODE_OUTPUT,
+      .pull_up_en = 0,
+      .pull_down_en = 0,
+  };
+  gpio_config(&power_io_cfg);
+
+  gpio_config_t input_io_cfg = {
+      .pin_bit_mask = (1ULL << USB_PLUG_PIN) | (1ULL << CHRG_STATE_PIN),
+      .mode = GPIO_MODE_INPUT,
+      .pull_up_en = 1,
+      .pull_down_en = 0,
+  };
+  gpio_config(&input_io_cfg);
+
+  // 2. Battery channel is sampled and calibrated by the shared ADC service
+  adc_service_init();
+
+  // Give the service a moment to deliver its first conversion
+  for (int i = 0; i < 10 && adc_service_read_raw(ADC_PIN) < 0; i++)
+    vTaskDelay(pdMS_TO_TICKS(10));
+
+  battery_state battery;
+  battery_level_sample(&battery);
+
+  input_battery_initialized = true;
+  scheduler_register("battery", battery_monitor_job, NULL, 500, 100);
+}
+
+void battery_level_read(battery_state *out_state) {
+  if (!input_battery_initialized)
+    return;
+
+  // Constant time, sampling is owned by battery_monitor_job
+  taskENTER_CRITICAL(&battery_lock);
+  *out_state = cached_battery;
+  taskEXIT_CRITICAL(&battery_lock);
+}
+
+void battery_level_force_voltage(float volts) { forced_adc_value = volts; }
+
+void battery_monitor_enabled_set(int value) {
+  battery_monitor_enabled = (bool)value;
+}
@@ -0,0 +1,241 @@
+#include "power_telemetry.h"
+#include "esp_clk_tree.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "lcd.h"
+#include "power.h"
+#include "scheduler.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *TAG = "power-telemetry";
+
+#define TELEMETRY_SAMPLE_PERIOD_MS 5000
+#define TELEMETRY_FLUSH_PERIOD_MS (5 * 60 * 1000)
+#define TELEMETRY_RING_SIZE 256 // records, ~21 minutes at 5 s
+#define TELEMETRY_FLUSH_LEVEL (TELEMETRY_RING_SIZE * 3 / 4)
+#define TELEMETRY_WRITE_BUFFER 4096
+#define TELEMETRY_LINE_MAX 48
+#define TELEMETRY_TAG_MAX 64 // longer session tags are cut
+
+typedef struct {
+  uint32_t uptime_s;
+  uint16_t millivolts;
+  uint8_t percentage;
+  uint8_t charge_state;
+  uint16_t cpu_mhz;
+  uint8_t backlight;
+  uint8_t reserved;
+} telemetry_record;
+
+static telemetry_record ring[TELEMETRY_RING_SIZE];
+static uint32_t ring_head = 0; // next write, free running
+static uint32_t ring_tail = 0; // next flush, free running
+static uint32_t dropped = 0;
+static portMUX_TYPE ring_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static char *log_path = NULL;
+static char *session_tag = NULL;
+static bool session_header_pending = false;
+static scheduler_job_handle sample_job = NULL;
+static TaskHandle_t flush_task_handle = NULL;
+static SemaphoreHandle_t flush_done = NULL;
+static volatile bool running = false;
+static TickType_t last_flush = 0;
+
+static void telemetry_sample(void *arg) {
+  battery_state battery;
+  battery_level_read(&battery);
+
+  uint32_t cpu_hz = 0;
+  esp_clk_tree_src_get_freq_hz(SOC_MOD_CLK_CPU,
+                               ESP_CLK_TREE_SRC_FREQ_PRECISION_CACHED, &cpu_hz);
+
+  telemetry_record rec = {
+      .uptime_s = xTaskGetTickCount() * portTICK_PERIOD_MS / 1000,
+      .millivolts = battery.millivolts,
+      .percentage = battery.percentage,
+      .charge_state = battery.state,
+      .cpu_mhz = cpu_hz / 1000000,
+      .backlight = lcd_get_brightness(),
+  };
+
+  taskENTER_CRITICAL(&ring_lock);
+  if (ring_head - ring_tail == TELEMETRY_RING_SIZE) {
+    ring_tail++; // overwrite the oldest sample
+    dropped++;
+  }
+  ring[ring_head % TELEMETRY_RING_SIZE] = rec;
+  ring_head++;
+  uint32_t level = ring_head - ring_tail;
+  taskEXIT_CRITICAL(&ring_lock);
+
+  TickType_t now = xTaskGetTickCount();
+  if (level >= TELEMETRY_FLUSH_LEVEL ||
+      (now - last_flush) >= pdMS_TO_TICKS(TELEMETRY_FLUSH_PERIOD_MS)) {
+    last_flush = now;
+    xTaskNotifyGive(flush_task_handle);
+  }
+}
+
+/**
+ * @brief snprintf at buffer + *used, never moving *used past the end
+ */
+static void buffer_append(char *buffer, size_t size, size_t *used,
+                          const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(buffer + *used, size - *used, fmt, args);
+  va_end(args);
+  if (n > 0)
+    *used = (*used + n < size) ? *used + n : size - 1;
+}
+
+/**
+ * @brief Format everything buffered and append it with a few large writes
+ */
+static void telemetry_write_out() {
+  static char buffer[TELEMETRY_WRITE_BUFFER];
+  size_t used = 0;
+
+  taskENTER_CRITICAL(&ring_lock);
+  uint32_t head = ring_head;
+  uint32_t tail = ring_tail;
+  taskEXIT_CRITICAL(&ring_lock);
+
+  if (head == tail && !session_header_pending)
+    return;
+
+  struct stat st;
+  bool new_file = stat(log_path, &st) != 0;
+  FILE *f = fopen(log_path, "a");
+  if (!f) {
+    ESP_LOGW(TAG, "Cannot open %s, keeping samples in RAM", log_path);
+    return;
+  }
+
+  if (new_file)
+    buffer_append(buffer, sizeof(buffer), &used,
+                  "uptime_s,millivolts,percentage,charge_state,cpu_mhz,"
+                  "backlight\n");
+  if (session_header_pending) {
+    buffer_append(buffer, sizeof(buffer), &used, "# session %s\n",
+                  session_tag);
+    session_header_pending = false;
+  }
+
+  bool ok = true;
+  while (tail != head) {
+    // Copy under the lock, the sampler may overwrite the slot meanwhile
+    taskENTER_CRITICAL(&ring_lock);
+    if ((int32_t)(ring_tail - tail) > 0)
+      tail = ring_tail; // samples were overwritten while writing
+    telemetry_record rec = ring[tail % TELEMETRY_RING_SIZE];
+    taskEXIT_CRITICAL(&ring_lock);
+    if (tail == head)
+      break;
+
+    buffer_append(buffer, sizeof(buffer), &used, "%lu,%u,%u,%u,%u,%u\n",
+                  (unsigned long)rec.uptime_s, rec.millivolts, rec.percentage,
+                  rec.charge_state, rec.cpu_mhz, rec.backlight);
+    tail++;
+
+    if (sizeof(buffer) - used < TELEMETRY_LINE_MAX) {
+      ok = fwrite(buffer, 1, used, f) == used;
+      used = 0;
+      if (!ok)
+        break;
+    }
+  }
+  if (ok && used)
+    ok = fwrite(buffer, 1, used, f) == used;
+  fclose(f);
+
+  if (!ok) {
+    ESP_LOGW(TAG, "Write to %s failed", log_path);
+    return;
+  }
+
+  taskENTER_CRITICAL(&ring_lock);
+  if ((int32_t)(tail - ring_tail) > 0)
+    ring_tail = tail;
+  taskEXIT_CRITICAL(&ring_lock);
+}
+
+static void telemetry_flush_task(void *arg) {
+  while (running) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    telemetry_write_out();
+  }
+
+  // Final write after stop
+  telemetry_write_out();
+  if (dropped)
+    ESP_LOGW(TAG, "%lu samples were dropped", (unsigned long)dropped);
+
+  flush_task_handle = NULL;
+  xSemaphoreGive(flush_done);
+  vTaskDelete(NULL);
+}
+
+esp_err_t power_telemetry_start(const char *path, const char *tag) {
+  if (running || !path)
+    return ESP_ERR_INVALID_STATE;
+
+  if (!flush_done)
+    flush_done = xSemaphoreCreateBinary();
+  log_path = strdup(path);
+  session_tag = strndup(tag ? tag : "unknown", TELEMETRY_TAG_MAX);
+  if (!flush_done || !log_path || !session_tag) {
+    free(log_path);
+    free(session_tag);
+    log_path = session_tag = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+
+  ring_head = ring_tail = dropped = 0;
+  session_header_pending = true;
+  last_flush = xTaskGetTickCount();
+  running = true;
+
+  // SD writes happen here, off the scheduler, at the lowest priority
+  if (xTaskCreatePinnedToCore(&telemetry_flush_task, "telemetry", 3072, NULL,
+                              1, &flush_task_handle, 0) != pdPASS) {
+    running = false;
+    free(log_path);
+    free(session_tag);
+    log_path = session_tag = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+
+  sample_job = scheduler_register("telemetry", telemetry_sample, NULL,
+                                  TELEMETRY_SAMPLE_PERIOD_MS, 1000);
+  ESP_LOGI(TAG, "Recording to %s (%s)", log_path, session_tag);
+  return ESP_OK;
+}
+
+void power_telemetry_flush() {
+  if (running && flush_task_handle)
+    xTaskNotifyGive(flush_task_handle);
+}
+
+void power_telemetry_stop() {
+  if (!running)
+    return;
+
+  scheduler_unregister(sample_job);
+  sample_job = NULL;
+
+  running = false;
+  xTaskNotifyGive(flush_task_handle);
+  xSemaphoreTake(flush_done, portMAX_DELAY);
+
+  free(log_path);
+  free(session_tag);
+  log_path = session_tag = NULL;
+}
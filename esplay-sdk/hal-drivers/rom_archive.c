@@ -0,0 +1,306 @@
+#include "rom_archive.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "rom/miniz.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "hal-archive";
+
+#define ARCHIVE_IN_CHUNK (16 * 1024)
+#define ZIP_LOCAL_SIG 0x04034b50
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_END_SIG 0x06054b50
+#define ZIP_END_SIZE 22
+#define ZIP_END_SEARCH (ZIP_END_SIZE + 0xFFFF)
+#define GZ_FHCRC 0x02
+#define GZ_FEXTRA 0x04
+#define GZ_FNAME 0x08
+#define GZ_FCOMMENT 0x10
+
+typedef enum { METHOD_STORED = 0, METHOD_DEFLATE = 8 } archive_method;
+
+// Where the compressed stream is and what it should produce
+typedef struct {
+  long data_offset;
+  size_t comp_size;
+  size_t size;
+  uint32_t crc;
+  int method;
+} archive_entry;
+
+static uint16_t get_le16(const uint8_t *p) { return p[0] | (p[1] << 8); }
+
+static uint32_t get_le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool has_suffix(const char *name, const char *suffix) {
+  size_t name_len = strlen(name);
+  size_t suffix_len = strlen(suffix);
+  return name_len > suffix_len &&
+         strcasecmp(name + name_len - suffix_len, suffix) == 0;
+}
+
+bool rom_archive_is_archive(const char *path) {
+  return has_suffix(path, ".zip") || has_suffix(path, ".gz");
+}
+
+/**
+ * @brief Find the end of central directory record. Without an archive
+ * comment it is the last ZIP_END_SIZE bytes, so that is tried first.
+ */
+static bool zip_find_end(FILE *f, uint16_t *entries, uint32_t *central_offset) {
+  if (fseek(f, 0, SEEK_END) != 0)
+    return false;
+  long file_size = ftell(f);
+  if (file_size < ZIP_END_SIZE)
+    return false;
+
+  uint8_t end[ZIP_END_SIZE];
+  if (fseek(f, file_size - ZIP_END_SIZE, SEEK_SET) == 0 &&
+      fread(end, 1, ZIP_END_SIZE, f) == ZIP_END_SIZE &&
+      get_le32(end) == ZIP_END_SIG) {
+    *entries = get_le16(end + 10);
+    *central_offset = get_le32(end + 16);
+    return true;
+  }
+
+  long search = file_size < ZIP_END_SEARCH ? file_size : ZIP_END_SEARCH;
+  uint8_t *tail = malloc(search);
+  if (!tail)
+    return false;
+  bool ok = fseek(f, file_size - search, SEEK_SET) == 0 &&
+            fread(tail, 1, search, f) == search;
+
+  bool found = false;
+  for (long i = search - ZIP_END_SIZE; ok && i >= 0; i--) {
+    if (get_le32(tail + i) == ZIP_END_SIG) {
+      *entries = get_le16(tail + i + 10);
+      *central_offset = get_le32(tail + i + 16);
+      found = true;
+      break;
+    }
+  }
+  free(tail);
+  return found;
+}
+
+/**
+ * @brief Locate the first file through the central directory, which has
+ * the sizes even when the local header defers them to a data descriptor.
+ * Its name is copied to name when that is not NULL.
+ */
+static bool zip_find_entry(FILE *f, archive_entry *entry, char *name,
+                           size_t name_size) {
+  uint16_t entries;
+  uint32_t central_offset;
+  if (!zip_find_end(f, &entries, &central_offset) ||
+      fseek(f, central_offset, SEEK_SET) != 0)
+    return false;
+
+  for (int i = 0; i < entries; i++) {
+    uint8_t hdr[46];
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) ||
+        get_le32(hdr) != ZIP_CENTRAL_SIG)
+      return false;
+
+    uint16_t name_len = get_le16(hdr + 28);
+    uint16_t skip = get_le16(hdr + 30) + get_le16(hdr + 32);
+    uint32_t size = get_le32(hdr + 24);
+    if (size == 0 || size == 0xFFFFFFFF) {
+      // Directory entry, or a zip64 entry we do not handle
+      fseek(f, name_len + skip, SEEK_CUR);
+      continue;
+    }
+
+    if (name) {
+      size_t n = name_len < name_size - 1 ? name_len : name_size - 1;
+      if (fread(name, 1, n, f) != n)
+        return false;
+      name[n] = '\0';
+    }
+
+    entry->method = get_le16(hdr + 10);
+    entry->crc = get_le32(hdr + 16);
+    entry->comp_size = get_le32(hdr + 20);
+    entry->size = size;
+    uint32_t local_offset = get_le32(hdr + 42);
+
+    uint8_t local[30];
+    if (fseek(f, local_offset, SEEK_SET) != 0 ||
+        fread(local, 1, sizeof(local), f) != sizeof(local) ||
+        get_le32(local) != ZIP_LOCAL_SIG)
+      return false;
+    entry->data_offset =
+        local_offset + sizeof(local) + get_le16(local + 26) +
+        get_le16(local + 28);
+    return true;
+  }
+  return false;
+}
+
+static bool gz_skip_string(FILE *f) {
+  int c;
+  while ((c = fgetc(f)) > 0)
+    ;
+  return c == 0;
+}
+
+static bool gz_find_entry(FILE *f, archive_entry *entry) {
+  uint8_t hdr[10];
+  if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr) || hdr[0] != 0x1F ||
+      hdr[1] != 0x8B || hdr[2] != METHOD_DEFLATE)
+    return false;
+
+  uint8_t flags = hdr[3];
+  if (flags & GZ_FEXTRA) {
+    uint8_t len[2];
+    if (fread(len, 1, 2, f) != 2 || fseek(f, get_le16(len), SEEK_CUR) != 0)
+      return false;
+  }
+  if ((flags & GZ_FNAME) && !gz_skip_string(f))
+    return false;
+  if ((flags & GZ_FCOMMENT) && !gz_skip_string(f))
+    return false;
+  if (flags & GZ_FHCRC)
+    fseek(f, 2, SEEK_CUR);
+  entry->data_offset = ftell(f);
+
+  // Trailer: CRC32 and size modulo 2^32
+  uint8_t trailer[8];
+  if (fseek(f, -8, SEEK_END) != 0 || fread(trailer, 1, 8, f) != 8)
+    return false;
+  entry->comp_size = ftell(f) - 8 - entry->data_offset;
+  entry->crc = get_le32(trailer);
+  entry->size = get_le32(trailer + 4);
+  entry->method = METHOD_DEFLATE;
+  return true;
+}
+
+static bool archive_find_entry(FILE *f, const char *path,
+                               archive_entry *entry) {
+  if (has_suffix(path, ".zip"))
+    return zip_find_entry(f, entry, NULL, 0);
+  return gz_find_entry(f, entry);
+}
+
+size_t rom_archive_get_size(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+  archive_entry entry;
+  bool ok = archive_find_entry(f, path, &entry);
+  fclose(f);
+  return ok ? entry.size : 0;
+}
+
+bool rom_archive_get_crc(const char *path, uint32_t *crc) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+  archive_entry entry;
+  bool ok = archive_find_entry(f, path, &entry);
+  fclose(f);
+  if (ok)
+    *crc = entry.crc;
+  return ok;
+}
+
+bool rom_archive_get_name(const char *path, char *name, size_t name_size) {
+  if (!has_suffix(path, ".zip") || name_size == 0)
+    return false;
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return false;
+  archive_entry entry;
+  bool ok = zip_find_entry(f, &entry, name, name_size);
+  fclose(f);
+  return ok;
+}
+
+/**
+ * @brief Stream the deflate data through a small input buffer into dest
+ */
+static size_t inflate_to(FILE *f, const archive_entry *entry, uint8_t *dest) {
+  tinfl_decompressor *inflator = malloc(sizeof(tinfl_decompressor));
+  uint8_t *in = malloc(ARCHIVE_IN_CHUNK);
+  if (!inflator || !in) {
+    free(inflator);
+    free(in);
+    return 0;
+  }
+  tinfl_init(inflator);
+
+  size_t comp_left = entry->comp_size;
+  size_t in_pos = 0, in_avail = 0, out_pos = 0;
+  tinfl_status status = TINFL_STATUS_FAILED;
+  do {
+    if (in_pos == in_avail && comp_left > 0) {
+      size_t want = comp_left < ARCHIVE_IN_CHUNK ? comp_left : ARCHIVE_IN_CHUNK;
+      in_avail = fread(in, 1, want, f);
+      in_pos = 0;
+      if (in_avail == 0)
+        break;
+      comp_left -= in_avail;
+    }
+
+    size_t in_bytes = in_avail - in_pos;
+    size_t out_bytes = entry->size - out_pos;
+    // The destination is the whole ROM, so it doubles as the window
+    uint32_t flags = TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF |
+                     (comp_left > 0 ? TINFL_FLAG_HAS_MORE_INPUT : 0);
+    status = tinfl_decompress(inflator, in + in_pos, &in_bytes, dest,
+                              dest + out_pos, &out_bytes, flags);
+    in_pos += in_bytes;
+    out_pos += out_bytes;
+  } while (status == TINFL_STATUS_NEEDS_MORE_INPUT);
+
+  free(in);
+  free(inflator);
+  return (status == TINFL_STATUS_DONE) ? out_pos : 0;
+}
+
+size_t rom_archive_load(const char *path, void *dest, size_t dest_size) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return 0;
+
+  archive_entry entry;
+  if (!archive_find_entry(f, path, &entry) || entry.size > dest_size ||
+      fseek(f, entry.data_offset, SEEK_SET) != 0) {
+    ESP_LOGE(TAG, "%s: no usable entry, or it does not fit", path);
+    fclose(f);
+    return 0;
+  }
+
+  int64_t start = esp_timer_get_time();
+  size_t size = 0;
+  if (entry.method == METHOD_STORED && entry.comp_size == entry.size)
+    size = fread(dest, 1, entry.size, f);
+  else if (entry.method == METHOD_DEFLATE)
+    size = inflate_to(f, &entry, dest);
+  else
+    ESP_LOGE(TAG, "%s: compression method %d not supported", path,
+             entry.method);
+  fclose(f);
+
+  if (size != entry.size) {
+    ESP_LOGE(TAG, "%s: inflate failed after %u bytes", path, (unsigned)size);
+    return 0;
+  }
+  if (esp_rom_crc32_le(0, dest, size) != entry.crc) {
+    ESP_LOGE(TAG, "%s: CRC mismatch", path);
+    return 0;
+  }
+
+  int64_t elapsed = esp_timer_get_time() - start;
+  ESP_LOGI(TAG, "%s: %u -> %u bytes in %lld ms, %.2f MB/s", path,
+           (unsigned)entry.comp_size, (unsigned)size, elapsed / 1000,
+           elapsed > 0 ? (double)size / elapsed : 0.0);
+  return size;
+}
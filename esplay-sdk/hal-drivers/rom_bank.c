@@ -0,0 +1,342 @@
+#include "rom_bank.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "hal-rom-bank";
+
+#define PREFETCH_QUEUE_DEPTH 4
+#define PREFETCH_STOP UINT32_MAX
+
+typedef enum { SLOT_EMPTY = 0, SLOT_LOADING, SLOT_READY } slot_state;
+
+typedef struct {
+  uint32_t bank;
+  uint32_t last_use;
+  uint16_t pins;
+  uint8_t state;
+  bool prefetched; // loaded ahead and not used yet
+  uint8_t *data;
+} bank_slot;
+
+struct rom_bank_cache {
+  int fd;
+  size_t rom_size;
+  size_t bank_size;
+  uint32_t bank_count;
+  uint8_t *memory;
+  bank_slot *slots;
+  int slot_count;
+  uint32_t use_clock;
+  rom_bank_stats stats;
+
+  // Lock order: io_lock, then lock. io_lock is held for the whole read of
+  // a slot, so waiting on it also waits for a bank being loaded.
+  SemaphoreHandle_t lock;
+  SemaphoreHandle_t io_lock;
+
+  QueueHandle_t prefetch_queue;
+  SemaphoreHandle_t prefetch_done;
+};
+
+static int slot_find(rom_bank_handle c, uint32_t bank) {
+  for (int i = 0; i < c->slot_count; i++)
+    if (c->slots[i].state != SLOT_EMPTY && c->slots[i].bank == bank)
+      return i;
+  return -1;
+}
+
+/**
+ * @brief Least recently used slot that is neither pinned nor loading
+ */
+static int slot_victim(rom_bank_handle c) {
+  int victim = -1;
+  for (int i = 0; i < c->slot_count; i++) {
+    bank_slot *s = &c->slots[i];
+    if (s->state == SLOT_EMPTY)
+      return i;
+    if (s->state == SLOT_READY && s->pins == 0 &&
+        (victim < 0 || (int32_t)(s->last_use - c->slots[victim].last_use) < 0))
+      victim = i;
+  }
+  return victim;
+}
+
+/**
+ * @brief Read one bank from SD. Caller holds io_lock, not lock.
+ */
+static bool bank_read(rom_bank_handle c, uint32_t bank, uint8_t *dest) {
+  size_t offset = (size_t)bank * c->bank_size;
+  size_t want = c->rom_size - offset;
+  if (want > c->bank_size)
+    want = c->bank_size;
+
+  if (lseek(c->fd, offset, SEEK_SET) != offset)
+    return false;
+  size_t got = 0;
+  while (got < want) {
+    ssize_t n = read(c->fd, dest + got, want - got);
+    if (n <= 0)
+      return false;
+    got += n;
+  }
+  if (want < c->bank_size)
+    memset(dest + want, 0xFF, c->bank_size - want);
+  return true;
+}
+
+/**
+ * @brief Load bank into a free or evicted slot. Caller holds io_lock.
+ *
+ * Returns the slot, or -1 if no slot could be freed or the read failed.
+ */
+static int bank_load(rom_bank_handle c, uint32_t bank, bool prefetch) {
+  xSemaphoreTake(c->lock, portMAX_DELAY);
+  int idx = slot_find(c, bank);
+  if (idx >= 0) {
+    xSemaphoreGive(c->lock);
+    return idx;
+  }
+  idx = slot_victim(c);
+  if (idx < 0) {
+    xSemaphoreGive(c->lock);
+    return -1;
+  }
+  bank_slot *s = &c->slots[idx];
+  if (s->state == SLOT_READY)
+    c->stats.evictions++;
+  s->bank = bank;
+  s->state = SLOT_LOADING;
+  xSemaphoreGive(c->lock);
+
+  bool ok = bank_read(c, bank, s->data);
+
+  xSemaphoreTake(c->lock, portMAX_DELAY);
+  s->state = ok ? SLOT_READY : SLOT_EMPTY;
+  s->prefetched = ok && prefetch;
+  s->last_use = c->use_clock++;
+  if (ok && prefetch)
+    c->stats.prefetches++;
+  xSemaphoreGive(c->lock);
+
+  if (!ok)
+    ESP_LOGE(TAG, "Reading bank %lu failed", (unsigned long)bank);
+  return ok ? idx : -1;
+}
+
+static void prefetch_task(void *arg) {
+  rom_bank_handle c = arg;
+  uint32_t bank;
+
+  while (xQueueReceive(c->prefetch_queue, &bank, portMAX_DELAY) == pdTRUE &&
+       bank != PREFETCH_STOP) {
+    xSemaphoreTake(c->io_lock, portMAX_DELAY);
+    bank_load(c, bank, true);
+    xSemaphoreGive(c->io_lock);
+  }
+
+  xSemaphoreGive(c->prefetch_done);
+  vTaskDelete(NULL);
+}
+
+/**
+ * @brief Pin a READY slot and update the counters. Caller holds lock.
+ */
+static const uint8_t *slot_pin(rom_bank_handle c, int idx) {
+  bank_slot *s = &c->slots[idx];
+  s->pins++;
+  s->last_use = c->use_clock++;
+  if (s->prefetched) {
+    s->prefetched = false;
+    c->stats.prefetch_hits++;
+  }
+  return s->data;
+}
+
+const uint8_t *rom_bank_acquire(rom_bank_handle c, uint32_t bank) {
+  if (!c || bank >= c->bank_count)
+    return NULL;
+
+  xSemaphoreTake(c->lock, portMAX_DELAY);
+  int idx = slot_find(c, bank);
+  if (idx >= 0 && c->slots[idx].state == SLOT_READY) {
+    c->stats.hits++;
+    const uint8_t *data = slot_pin(c, idx);
+    xSemaphoreGive(c->lock);
+    return data;
+  }
+  xSemaphoreGive(c->lock);
+
+  // Miss, or the prefetcher is loading it right now: either way io_lock
+  // serialises us behind any read in flight
+  xSemaphoreTake(c->io_lock, portMAX_DELAY);
+  xSemaphoreTake(c->lock, portMAX_DELAY);
+  idx = slot_find(c, bank);
+  bool loaded = idx >= 0 && c->slots[idx].state == SLOT_READY;
+  xSemaphoreGive(c->lock);
+
+  if (!loaded) {
+    idx = bank_load(c, bank, false);
+    if (idx < 0) {
+      xSemaphoreGive(c->io_lock);
+      ESP_LOGW(TAG, "No slot for bank %lu", (unsigned long)bank);
+      return NULL;
+    }
+  }
+
+  xSemaphoreTake(c->lock, portMAX_DELAY);
+  if (loaded)
+    c->stats.hits++;
+  else
+    c->stats.misses++;
+  const uint8_t *data = slot_pin(c, idx);
+  xSemaphoreGive(c->lock);
+  xSemaphoreGive(c->io_lock);
+
+  if (!loaded && c->prefetch_queue && bank + 1 < c->bank_count) {
+    uint32_t next = bank + 1;
+    xQueueSend(c->prefetch_queue, &next, 0);
+  }
+  return data;
+}
+
+void rom_bank_release(rom_bank_handle c, uint32_t bank) {
+  if (!c)
+    return;
+  xSemaphoreTake(c->lock, portMAX_DELAY);
+  int idx = slot_find(c, bank);
+  if (idx >= 0 && c->slots[idx].pins > 0)
+    c->slots[idx].pins--;
+  xSemaphoreGive(c->lock);
+}
+
+size_t rom_bank_read(rom_bank_handle c, uint32_t offset, void *dest,
+                     size_t len) {
+  size_t done = 0;
+  while (done < len && offset < c->rom_size) {
+    uint32_t bank = offset / c->bank_size;
+    size_t in_bank = offset & (c->bank_size - 1);
+    size_t n = c->bank_size - in_bank;
+    if (n > len - done)
+      n = len - done;
+    if (n > c->rom_size - offset)
+      n = c->rom_size - offset;
+
+    const uint8_t *data = rom_bank_acquire(c, bank);
+    if (!data)
+      break;
+    memcpy((uint8_t *)dest + done, data + in_bank, n);
+    rom_bank_release(c, bank);
+
+    done += n;
+    offset += n;
+  }
+  return done;
+}
+
+size_t rom_bank_rom_size(rom_bank_handle c) { return c ? c->rom_size : 0; }
+
+uint32_t rom_bank_count(rom_bank_handle c) { return c ? c->bank_count : 0; }
+
+void rom_bank_get_stats(rom_bank_handle c, rom_bank_stats *out) {
+  xSemaphoreTake(c->lock, portMAX_DELAY);
+  *out = c->stats;
+  xSemaphoreGive(c->lock);
+}
+
+rom_bank_handle rom_bank_open(const char *path, size_t bank_size,
+                              size_t cache_size, bool prefetch) {
+  if (bank_size == 0 || (bank_size & (bank_size - 1)) ||
+      cache_size / bank_size < 2)
+    return NULL;
+
+  rom_bank_handle c = calloc(1, sizeof(struct rom_bank_cache));
+  if (!c)
+    return NULL;
+  c->fd = open(path, O_RDONLY);
+  struct stat st;
+  if (c->fd < 0 || fstat(c->fd, &st) != 0) {
+    ESP_LOGE(TAG, "Cannot open %s", path);
+    rom_bank_close(c);
+    return NULL;
+  }
+
+  c->rom_size = st.st_size;
+  c->bank_size = bank_size;
+  c->bank_count = (c->rom_size + bank_size - 1) / bank_size;
+  c->slot_count = cache_size / bank_size;
+  if (c->slot_count > c->bank_count)
+    c->slot_count = c->bank_count ? c->bank_count : 1;
+
+  c->memory = heap_caps_malloc(c->slot_count * bank_size,
+                               MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!c->memory)
+    c->memory = heap_caps_malloc(c->slot_count * bank_size, MALLOC_CAP_8BIT);
+  c->slots = calloc(c->slot_count, sizeof(bank_slot));
+  c->lock = xSemaphoreCreateMutex();
+  c->io_lock = xSemaphoreCreateMutex();
+  if (!c->memory || !c->slots || !c->lock || !c->io_lock) {
+    ESP_LOGE(TAG, "Out of memory for %d banks of %u bytes", c->slot_count,
+             (unsigned)bank_size);
+    rom_bank_close(c);
+    return NULL;
+  }
+  for (int i = 0; i < c->slot_count; i++)
+    c->slots[i].data = c->memory + i * bank_size;
+
+  if (prefetch) {
+    c->prefetch_queue = xQueueCreate(PREFETCH_QUEUE_DEPTH, sizeof(uint32_t));
+    c->prefetch_done = xSemaphoreCreateBinary();
+    if (!c->prefetch_queue || !c->prefetch_done ||
+        xTaskCreate(prefetch_task, "rom_prefetch", 2560, c, 3, NULL) !=
+            pdPASS) {
+      ESP_LOGW(TAG, "Prefetch disabled");
+      if (c->prefetch_queue)
+        vQueueDelete(c->prefetch_queue);
+      if (c->prefetch_done)
+        vSemaphoreDelete(c->prefetch_done);
+      c->prefetch_queue = NULL;
+      c->prefetch_done = NULL;
+    }
+  }
+
+  ESP_LOGI(TAG, "%s: %lu banks of %u bytes, %d cached", path,
+           (unsigned long)c->bank_count, (unsigned)bank_size, c->slot_count);
+  return c;
+}
+
+void rom_bank_close(rom_bank_handle c) {
+  if (!c)
+    return;
+
+  if (c->prefetch_queue) {
+    uint32_t stop = PREFETCH_STOP;
+    xQueueSend(c->prefetch_queue, &stop, portMAX_DELAY);
+    xSemaphoreTake(c->prefetch_done, portMAX_DELAY);
+    vQueueDelete(c->prefetch_queue);
+    vSemaphoreDelete(c->prefetch_done);
+  }
+
+  ESP_LOGI(TAG, "hits %lu, misses %lu, prefetched %lu (%lu used)",
+           (unsigned long)c->stats.hits, (unsigned long)c->stats.misses,
+           (unsigned long)c->stats.prefetches,
+           (unsigned long)c->stats.prefetch_hits);
+
+  if (c->fd >= 0)
+    close(c->fd);
+  if (c->lock)
+    vSemaphoreDelete(c->lock);
+  if (c->io_lock)
+    vSemaphoreDelete(c->io_lock);
+  heap_caps_free(c->memory);
+  free(c->slots);
+  free(c);
+}
@@ -0,0 +1,499 @@
+#include "rom_catalog.h"
+#include "esp_log.h"
+#include "ff.h"
+#include "save_service.h"
+#include "sdcard_internal.h"
+#include "sdcard_sort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "hal-catalog";
+
+#define CATALOG_MAGIC 0x54414352 // "RCAT"
+#define CATALOG_VERSION 3
+#define CATALOG_FILE ".catalog"
+#define CATALOG_EXT_LEN 16
+#define CATALOG_PATH_MAX 272
+
+// On-disk layout: header, count listed records, skipped records, then the
+// NUL-terminated names. Skipped records are zips whose ROM has another
+// extension, kept so a rebuild does not open them again. Both runs are in
+// name order. The whole file is loaded with one read, checked by cat_load()
+// and used in place.
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  char extension[CATALOG_EXT_LEN];
+  uint32_t count;
+  uint32_t skipped;
+  uint32_t names_size;
+  uint32_t fingerprint; // hash of the ROM and zip directory entries
+} catalog_header;
+
+typedef struct {
+  uint32_t name_offset;
+  uint32_t size;
+  uint32_t crc;
+  uint16_t fdate;
+  uint16_t ftime;
+} catalog_record;
+
+struct rom_catalog {
+  char *path;
+  char *file_path;
+  char *dir_path;
+  char extension[CATALOG_EXT_LEN];
+  uint8_t *image;
+  size_t image_size;
+  bool crc_dirty;
+};
+
+// Scan result before sorting, names point into a growing blob
+typedef struct {
+  uint32_t name_offset;
+  uint32_t size;
+  uint16_t fdate;
+  uint16_t ftime;
+  bool zip;    // listed only if the ROM inside matches
+  bool listed; // decided by cat_rebuild()
+} scan_entry;
+
+typedef struct {
+  scan_entry *entries;
+  int count;
+  int capacity;
+  char *names;
+  size_t names_size;
+  size_t names_capacity;
+  uint32_t fingerprint;
+} scan_result;
+
+static inline catalog_header *cat_header(rom_catalog_handle cat) {
+  return (catalog_header *)cat->image;
+}
+
+static inline catalog_record *cat_records(rom_catalog_handle cat) {
+  return (catalog_record *)(cat->image + sizeof(catalog_header));
+}
+
+static inline uint32_t cat_total(rom_catalog_handle cat) {
+  return cat_header(cat)->count + cat_header(cat)->skipped;
+}
+
+static inline const char *cat_names(rom_catalog_handle cat) {
+  return (const char *)(cat_records(cat) + cat_total(cat));
+}
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t len) {
+  const uint8_t *p = data;
+  while (len--)
+    hash = (hash ^ *p++) * 16777619u;
+  return hash;
+}
+
+static bool scan_add(scan_result *scan, const FILINFO *info, bool zip) {
+  size_t name_len = strlen(info->fname) + 1;
+  if (scan->count == scan->capacity) {
+    int capacity = scan->capacity ? scan->capacity * 2 : 64;
+    scan_entry *entries = realloc(scan->entries, capacity * sizeof(scan_entry));
+    if (!entries)
+      return false;
+    scan->entries = entries;
+    scan->capacity = capacity;
+  }
+  if (scan->names_size + name_len > scan->names_capacity) {
+    size_t capacity = scan->names_capacity ? scan->names_capacity * 2 : 2048;
+    while (capacity < scan->names_size + name_len)
+      capacity *= 2;
+    char *names = realloc(scan->names, capacity);
+    if (!names)
+      return false;
+    scan->names = names;
+    scan->names_capacity = capacity;
+  }
+
+  scan_entry *e = &scan->entries[scan->count++];
+  e->name_offset = scan->names_size;
+  e->size = info->fsize;
+  e->fdate = info->fdate;
+  e->ftime = info->ftime;
+  e->zip = zip;
+  memcpy(scan->names + scan->names_size, info->fname, name_len);
+  scan->names_size += name_len;
+  return true;
+}
+
+/**
+ * @brief One FatFS pass over the folder collecting ROMs and zips by name,
+ * without opening any file
+ */
+static bool scan_dir(rom_catalog_handle cat, scan_result *scan) {
+  memset(scan, 0, sizeof(*scan));
+  scan->fingerprint = 2166136261u;
+
+  FF_DIR dir;
+  if (f_opendir(&dir, cat->dir_path) != FR_OK)
+    return false;
+
+  FILINFO info;
+  bool ok = true;
+  while (f_readdir(&dir, &info) == FR_OK && info.fname[0]) {
+    if (info.fname[0] == '.' || (info.fattrib & AM_DIR))
+      continue;
+    sdcard_name_class kind = sdcard_name_classify(info.fname, cat->extension);
+    if (kind == SDCARD_NAME_OTHER)
+      continue;
+
+    scan->fingerprint =
+        fnv1a(scan->fingerprint, info.fname, strlen(info.fname) + 1);
+    scan->fingerprint = fnv1a(scan->fingerprint, &info.fsize, sizeof(FSIZE_t));
+    scan->fingerprint = fnv1a(scan->fingerprint, &info.fdate, sizeof(WORD));
+    scan->fingerprint = fnv1a(scan->fingerprint, &info.ftime, sizeof(WORD));
+    if (!scan_add(scan, &info, kind == SDCARD_NAME_ZIP)) {
+      ok = false;
+      break;
+    }
+  }
+  f_closedir(&dir);
+  return ok;
+}
+
+static void scan_free(scan_result *scan) {
+  free(scan->entries);
+  free(scan->names);
+}
+
+static int scan_offset_cmp(const void *a, const void *b) {
+  uint32_t x = ((const scan_entry *)a)->name_offset;
+  uint32_t y = ((const scan_entry *)b)->name_offset;
+  return x < y ? -1 : x > y;
+}
+
+/**
+ * @brief Entry whose name starts at name, entries are in name offset order
+ */
+static scan_entry *scan_entry_of(const scan_result *scan, const char *name) {
+  scan_entry key = {.name_offset = name - scan->names};
+  return bsearch(&key, scan->entries, scan->count, sizeof(scan_entry),
+                 scan_offset_cmp);
+}
+
+/**
+ * @brief Binary search count records of the current catalog from first,
+ * -1 if the name is not there
+ */
+static int cat_find(rom_catalog_handle cat, const char *name, int first,
+                    int count) {
+  if (!cat->image)
+    return -1;
+  const catalog_record *records = cat_records(cat);
+  const char *names = cat_names(cat);
+  int low = first, high = first + count - 1;
+  while (low <= high) {
+    int mid = (low + high) / 2;
+    int d = sdcard_name_cmp(name, names + records[mid].name_offset);
+    if (d == 0)
+      return mid;
+    if (d < 0)
+      high = mid - 1;
+    else
+      low = mid + 1;
+  }
+  return -1;
+}
+
+static bool cat_write(rom_catalog_handle cat, const uint8_t *image,
+                      size_t size) {
+  FILE *f = save_service_open(cat->file_path);
+  if (!f)
+    return false;
+  if (fwrite(image, 1, size, f) != size) {
+    save_service_abort(f, cat->file_path);
+    return false;
+  }
+  return save_service_commit(f, cat->file_path);
+}
+
+/**
+ * @brief Record of name in the current catalog if its size and date are
+ * unchanged, NULL otherwise. listed tells which run it is in.
+ */
+static const catalog_record *cat_previous(rom_catalog_handle cat,
+                                          const char *name,
+                                          const scan_entry *e, bool *listed) {
+  if (!cat->image)
+    return NULL;
+  const catalog_header *header = cat_header(cat);
+  int i = cat_find(cat, name, 0, header->count);
+  *listed = i >= 0;
+  if (i < 0)
+    i = cat_find(cat, name, header->count, header->skipped);
+  if (i < 0)
+    return NULL;
+
+  const catalog_record *prev = &cat_records(cat)[i];
+  bool same = prev->size == e->size && prev->fdate == e->fdate &&
+              prev->ftime == e->ftime;
+  return same ? prev : NULL;
+}
+
+/**
+ * @brief Build a new image from a scan, keeping CRCs of unchanged files.
+ * Only new or changed zips are opened to see what they hold.
+ */
+static bool cat_rebuild(rom_catalog_handle cat, scan_result *scan) {
+  // Sorted with the listing sorter, then mapped back to the scan entries
+  char **order = malloc((scan->count ? scan->count : 1) * sizeof(char *));
+  if (!order)
+    return false;
+  for (int i = 0; i < scan->count; i++)
+    order[i] = scan->names + scan->entries[i].name_offset;
+  sdcard_sort_names(order, scan->count);
+
+  int listed_count = 0, opened = 0;
+  for (int i = 0; i < scan->count; i++) {
+    scan_entry *e = scan_entry_of(scan, order[i]);
+    e->listed = true;
+    if (e->zip) {
+      bool was_listed;
+      if (cat_previous(cat, order[i], e, &was_listed)) {
+        e->listed = was_listed;
+      } else {
+        e->listed = sdcard_zip_matches(cat->path, order[i], cat->extension);
+        opened++;
+      }
+    }
+    listed_count += e->listed;
+  }
+
+  size_t size = sizeof(catalog_header) + scan->count * sizeof(catalog_record) +
+                scan->names_size;
+  uint8_t *image = malloc(size);
+  if (!image) {
+    free(order);
+    return false;
+  }
+
+  catalog_header *header = (catalog_header *)image;
+  catalog_record *records = (catalog_record *)(image + sizeof(catalog_header));
+  char *names = (char *)(records + scan->count);
+
+  *header = (catalog_header){
+      .magic = CATALOG_MAGIC,
+      .version = CATALOG_VERSION,
+      .record_size = sizeof(catalog_record),
+      .count = listed_count,
+      .skipped = scan->count - listed_count,
+      .names_size = scan->names_size,
+      .fingerprint = scan->fingerprint,
+  };
+  strcpy(header->extension, cat->extension);
+
+  // Listed entries first, then the skipped zips, each run in name order
+  int reused = 0, r = 0;
+  size_t offset = 0;
+  for (int run = 0; run < 2; run++) {
+    for (int i = 0; i < scan->count; i++) {
+      const char *name = order[i];
+      const scan_entry *e = scan_entry_of(scan, name);
+      if (e->listed != (run == 0))
+        continue;
+
+      records[r] = (catalog_record){
+          .name_offset = offset,
+          .size = e->size,
+          .fdate = e->fdate,
+          .ftime = e->ftime,
+      };
+
+      bool was_listed;
+      const catalog_record *prev = cat_previous(cat, name, e, &was_listed);
+      if (prev && was_listed && e->listed) {
+        records[r].crc = prev->crc;
+        reused++;
+      }
+      r++;
+
+      size_t len = strlen(name) + 1;
+      memcpy(names + offset, name, len);
+      offset += len;
+    }
+  }
+  free(order);
+
+  free(cat->image);
+  cat->image = image;
+  cat->image_size = size;
+  cat->crc_dirty = false;
+
+  if (!cat_write(cat, image, size)) {
+    ESP_LOGW(TAG, "Cannot write %s", cat->file_path);
+    return true;
+  }
+
+  ESP_LOGI(TAG, "%s: %d entries, %d unchanged, %d zips opened",
+           cat->dir_path, listed_count, reused, opened);
+  return true;
+}
+
+/**
+ * @brief Check that every record points inside the names and each name is
+ * terminated, so a damaged file cannot send lookups out of bounds
+ */
+static bool cat_image_valid(const uint8_t *image) {
+  const catalog_header *header = (const catalog_header *)image;
+  const catalog_record *records =
+      (const catalog_record *)(image + sizeof(catalog_header));
+  uint32_t total = header->count + header->skipped;
+  const char *names = (const char *)(records + total);
+
+  if (total && names[header->names_size - 1] != '\0')
+    return false;
+  for (uint32_t i = 0; i < total; i++) {
+    if (records[i].name_offset >= header->names_size)
+      return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Read the saved catalog, false if missing, damaged or not matching
+ */
+static bool cat_load(rom_catalog_handle cat) {
+  if (!save_service_recover(cat->file_path))
+    return false;
+  FILE *f = fopen(cat->file_path, "rb");
+  if (!f)
+    return false;
+
+  long file_size = -1;
+  if (fseek(f, 0, SEEK_END) == 0)
+    file_size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  // Sizes are checked against the file before they are used for anything
+  catalog_header header;
+  bool ok = file_size >= (long)sizeof(header) &&
+            fread(&header, 1, sizeof(header), f) == sizeof(header) &&
+            header.magic == CATALOG_MAGIC &&
+            header.version == CATALOG_VERSION &&
+            header.record_size == sizeof(catalog_record) &&
+            strncmp(header.extension, cat->extension, CATALOG_EXT_LEN) == 0;
+  size_t body = ok ? file_size - sizeof(header) : 0;
+  size_t max_records = body / sizeof(catalog_record);
+  ok = ok && header.count <= max_records &&
+       header.skipped <= max_records - header.count;
+  size_t total = ok ? header.count + header.skipped : 0;
+  ok = ok && header.names_size == body - total * sizeof(catalog_record) &&
+       (total == 0 || header.names_size > 0);
+
+  size_t size = sizeof(header) + body;
+  uint8_t *image = ok ? malloc(size) : NULL;
+  if (image) {
+    memcpy(image, &header, sizeof(header));
+    ok = fread(image + sizeof(header), 1, body, f) == body &&
+         cat_image_valid(image);
+  } else {
+    ok = false;
+  }
+  fclose(f);
+
+  if (!ok) {
+    if (file_size >= 0)
+      ESP_LOGW(TAG, "Ignoring damaged or outdated %s", cat->file_path);
+    free(image);
+    return false;
+  }
+  cat->image = image;
+  cat->image_size = size;
+  return true;
+}
+
+bool rom_catalog_refresh(rom_catalog_handle cat, bool force) {
+  scan_result scan;
+  if (!scan_dir(cat, &scan)) {
+    scan_free(&scan);
+    return false;
+  }
+
+  // Same folder content: keep the loaded catalog and its CRCs as they are
+  bool changed = false;
+  if (force || !cat->image ||
+      cat_header(cat)->fingerprint != scan.fingerprint ||
+      cat_total(cat) != scan.count)
+    changed = cat_rebuild(cat, &scan);
+
+  scan_free(&scan);
+  return changed;
+}
+
+rom_catalog_handle rom_catalog_open(const char *path,
+                                    const char *extension) {
+  if (strlen(extension) >= CATALOG_EXT_LEN)
+    return NULL;
+
+  char dir_path[CATALOG_PATH_MAX];
+  if (!sdcard_fatfs_path(path, dir_path, sizeof(dir_path)))
+    return NULL;
+
+  rom_catalog_handle cat = calloc(1, sizeof(struct rom_catalog));
+  if (!cat)
+    return NULL;
+  strcpy(cat->extension, extension);
+  cat->path = strdup(path);
+  cat->dir_path = strdup(dir_path);
+  if (asprintf(&cat->file_path, "%s/" CATALOG_FILE, path) < 0)
+    cat->file_path = NULL;
+  if (!cat->path || !cat->dir_path || !cat->file_path) {
+    rom_catalog_close(cat);
+    return NULL;
+  }
+
+  cat_load(cat);
+  rom_catalog_refresh(cat, false);
+  if (!cat->image) {
+    rom_catalog_close(cat);
+    return NULL;
+  }
+  return cat;
+}
+
+int rom_catalog_count(rom_catalog_handle cat) {
+  return (cat && cat->image) ? cat_header(cat)->count : 0;
+}
+
+bool rom_catalog_get(rom_catalog_handle cat, int index,
+                     rom_catalog_entry *out) {
+  if (index < 0 || index >= rom_catalog_count(cat))
+    return false;
+
+  const catalog_record *rec = &cat_records(cat)[index];
+  out->name = cat_names(cat) + rec->name_offset;
+  out->size = rec->size;
+  out->crc = rec->crc;
+  return true;
+}
+
+void rom_catalog_set_crc(rom_catalog_handle cat, int index, uint32_t crc) {
+  if (index < 0 || index >= rom_catalog_count(cat))
+    return;
+  cat_records(cat)[index].crc = crc;
+  cat->crc_dirty = true;
+}
+
+void rom_catalog_close(rom_catalog_handle cat) {
+  if (!cat)
+    return;
+
+  // The whole image goes through the same swap, a cut keeps the old file
+  if (cat->crc_dirty && !cat_write(cat, cat->image, cat->image_size))
+    ESP_LOGW(TAG, "Cannot write %s", cat->file_path);
+
+  free(cat->image);
+  free(cat->path);
+  free(cat->dir_path);
+  free(cat->file_path);
+  free(cat);
+}
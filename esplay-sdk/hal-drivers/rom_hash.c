@@ -0,0 +1,463 @@
+#include "rom_hash.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "ff.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "rom_archive.h"
+#include "save_service.h"
+#include "sdcard.h"
+#include "sdcard_internal.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char *TAG = "hal-romhash";
+
+#define HASH_MAGIC 0x48534852 // "RHSH"
+#define HASH_VERSION 3
+#define HASH_CHUNK (16 * 1024)
+#define HASH_SAVE_EVERY 16 // CRCs computed between saves while indexing
+#define HASH_QUEUE_DEPTH 8
+#define HASH_PATH_MAX 512
+#define HASH_NOT_ROM 0x0001 // record flag, no CRC
+
+// On-disk layout: header, then count records sorted by path hash and length.
+// The file is loaded whole and kept in RAM, 32 bytes per ROM. Zips holding
+// a ROM for another system get a HASH_NOT_ROM record, so an unchanged zip
+// is not opened again on the next pass.
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;
+  uint32_t count;
+} hash_header;
+
+// A path is known by its 64-bit hash and its length; two paths agreeing on
+// both are not expected on one card
+typedef struct {
+  uint64_t hash;
+  uint32_t len;
+} path_key;
+
+typedef struct {
+  uint64_t path_hash;
+  uint64_t dir_hash; // folder, to drop entries of deleted files
+  uint16_t path_len;
+  uint16_t flags;
+  uint32_t size;
+  uint32_t datetime; // FAT fdate << 16 | ftime
+  uint32_t crc;
+} hash_record;
+
+typedef struct {
+  char *path; // NULL wakes the task to stop
+  char *extension;
+} folder_request;
+
+static char *index_path = NULL;
+static hash_record *records = NULL;
+static int record_count = 0;
+static int record_capacity = 0;
+static int unsaved = 0;
+static SemaphoreHandle_t index_lock = NULL;
+static QueueHandle_t folder_queue = NULL;
+static SemaphoreHandle_t indexer_done = NULL;
+static TaskHandle_t indexer_handle = NULL;
+static volatile bool stop_requested = false;
+
+/**
+ * @brief 64-bit FNV-1a of a path, case folded like FAT names
+ */
+static path_key path_key_of(const char *path, size_t len) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)tolower((unsigned char)path[i]);
+    hash *= 1099511628211ull;
+  }
+  return (path_key){hash, len};
+}
+
+static int key_cmp(const void *a, const void *b) {
+  const path_key *x = a, *y = b;
+  if (x->hash != y->hash)
+    return x->hash < y->hash ? -1 : 1;
+  return x->len < y->len ? -1 : x->len > y->len;
+}
+
+static path_key record_key(const hash_record *rec) {
+  return (path_key){rec->path_hash, rec->path_len};
+}
+
+/**
+ * @brief Binary search, returns the match or the insert position
+ */
+static int record_find(path_key key, bool *found) {
+  int low = 0, high = record_count - 1;
+  while (low <= high) {
+    int mid = (low + high) / 2;
+    path_key mid_key = record_key(&records[mid]);
+    int d = key_cmp(&mid_key, &key);
+    if (d == 0) {
+      *found = true;
+      return mid;
+    }
+    if (d < 0)
+      low = mid + 1;
+    else
+      high = mid - 1;
+  }
+  *found = false;
+  return low;
+}
+
+/**
+ * @brief Insert or replace. Caller holds index_lock.
+ */
+static bool record_put(const hash_record *rec) {
+  bool found;
+  int i = record_find(record_key(rec), &found);
+  if (found) {
+    records[i] = *rec;
+    return true;
+  }
+
+  if (record_count == record_capacity) {
+    int capacity = record_capacity ? record_capacity * 2 : 64;
+    hash_record *grown = realloc(records, capacity * sizeof(hash_record));
+    if (!grown)
+      return false;
+    records = grown;
+    record_capacity = capacity;
+  }
+  memmove(&records[i + 1], &records[i],
+          (record_count - i) * sizeof(hash_record));
+  records[i] = *rec;
+  record_count++;
+  return true;
+}
+
+/**
+ * @brief Record of key in this size and date. Asking for the CRC skips
+ * HASH_NOT_ROM records, without crc any record counts as known.
+ */
+static bool index_lookup(path_key key, uint32_t size, uint32_t datetime,
+                         uint32_t *crc) {
+  xSemaphoreTake(index_lock, portMAX_DELAY);
+  bool found;
+  int i = record_find(key, &found);
+  found = found && records[i].size == size && records[i].datetime == datetime &&
+          !(crc && (records[i].flags & HASH_NOT_ROM));
+  if (found && crc)
+    *crc = records[i].crc;
+  xSemaphoreGive(index_lock);
+  return found;
+}
+
+static void index_load() {
+  if (!save_service_recover(index_path))
+    return;
+  FILE *f = fopen(index_path, "rb");
+  if (!f)
+    return;
+
+  hash_header header;
+  bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+            header.magic == HASH_MAGIC && header.version == HASH_VERSION &&
+            header.record_size == sizeof(hash_record);
+  hash_record *loaded =
+      ok && header.count ? malloc(header.count * sizeof(hash_record)) : NULL;
+  if (loaded &&
+      fread(loaded, sizeof(hash_record), header.count, f) == header.count) {
+    records = loaded;
+    record_count = record_capacity = header.count;
+  } else {
+    free(loaded);
+  }
+  fclose(f);
+  ESP_LOGI(TAG, "%d ROM CRCs in %s", record_count, index_path);
+}
+
+/**
+ * @brief Write the index to a temp file and swap it in. Caller holds
+ * index_lock.
+ */
+static bool index_save() {
+  FILE *f = save_service_open(index_path);
+  if (!f)
+    return false;
+  hash_header header = {
+      .magic = HASH_MAGIC,
+      .version = HASH_VERSION,
+      .record_size = sizeof(hash_record),
+      .count = record_count,
+  };
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(records, sizeof(hash_record), record_count, f) ==
+                record_count;
+  if (!ok) {
+    save_service_abort(f, index_path);
+    return false;
+  }
+  if (!save_service_commit(f, index_path))
+    return false;
+  unsaved = 0;
+  return true;
+}
+
+/**
+ * @brief CRC32 of the ROM data, read in chunks with the ROM table CRC
+ */
+static bool hash_file(const char *path, uint32_t *crc,
+                      volatile bool *cancel) {
+  if (rom_archive_is_archive(path))
+    return rom_archive_get_crc(path, crc);
+
+  FILE *f = fopen(path, "rb");
+  uint8_t *buffer = malloc(HASH_CHUNK);
+  bool ok = f && buffer;
+  uint32_t value = 0;
+  size_t n;
+  while (ok && (n = fread(buffer, 1, HASH_CHUNK, f)) > 0) {
+    value = esp_rom_crc32_le(value, buffer, n);
+    if (cancel && *cancel)
+      ok = false;
+  }
+  if (f) {
+    ok &= !ferror(f);
+    fclose(f);
+  }
+  free(buffer);
+
+  if (ok)
+    *crc = value;
+  return ok;
+}
+
+/**
+ * @brief Drop the folder's entries that were not seen in a full pass
+ */
+static void index_prune(uint64_t dir_hash, path_key *seen, int seen_count) {
+  qsort(seen, seen_count, sizeof(path_key), key_cmp);
+
+  xSemaphoreTake(index_lock, portMAX_DELAY);
+  int kept = 0;
+  for (int i = 0; i < record_count; i++) {
+    path_key key = record_key(&records[i]);
+    if (records[i].dir_hash == dir_hash &&
+        !bsearch(&key, seen, seen_count, sizeof(path_key), key_cmp))
+      continue;
+    records[kept++] = records[i];
+  }
+  if (kept != record_count) {
+    ESP_LOGI(TAG, "Dropped %d stale entries", record_count - kept);
+    record_count = kept;
+    unsaved++;
+  }
+  xSemaphoreGive(index_lock);
+}
+
+static void index_folder(const folder_request *req) {
+  char dir_path[HASH_PATH_MAX];
+  FF_DIR dir;
+  if (!sdcard_fatfs_path(req->path, dir_path, sizeof(dir_path)) ||
+      f_opendir(&dir, dir_path) != FR_OK) {
+    ESP_LOGW(TAG, "Cannot read %s", req->path);
+    return;
+  }
+
+  uint64_t dir_hash = path_key_of(req->path, strlen(req->path)).hash;
+  path_key *seen = NULL;
+  int seen_count = 0, seen_capacity = 0;
+  bool complete = true;
+  int hashed = 0;
+
+  FILINFO info;
+  char path[HASH_PATH_MAX];
+  while (f_readdir(&dir, &info) == FR_OK && info.fname[0]) {
+    if (stop_requested) {
+      complete = false;
+      break;
+    }
+    if (info.fname[0] == '.' || (info.fattrib & AM_DIR))
+      continue;
+    sdcard_name_class kind = sdcard_name_classify(info.fname, req->extension);
+    if (kind == SDCARD_NAME_OTHER)
+      continue;
+
+    snprintf(path, sizeof(path), "%s/%s", req->path, info.fname);
+    path_key key = path_key_of(path, strlen(path));
+    uint32_t datetime = (uint32_t)info.fdate << 16 | info.ftime;
+
+    if (seen_count == seen_capacity) {
+      int capacity = seen_capacity ? seen_capacity * 2 : 64;
+      path_key *grown = realloc(seen, capacity * sizeof(path_key));
+      if (!grown) {
+        complete = false;
+        break;
+      }
+      seen = grown;
+      seen_capacity = capacity;
+    }
+    seen[seen_count++] = key;
+
+    if (index_lookup(key, info.fsize, datetime, NULL))
+      continue;
+
+    hash_record rec = {key.hash, dir_hash, key.len, 0, info.fsize, datetime, 0};
+    if (kind == SDCARD_NAME_ZIP &&
+        !sdcard_zip_matches(req->path, info.fname, req->extension)) {
+      rec.flags = HASH_NOT_ROM;
+      xSemaphoreTake(index_lock, portMAX_DELAY);
+      if (record_put(&rec))
+        unsaved++;
+      xSemaphoreGive(index_lock);
+      continue;
+    }
+    if (!hash_file(path, &rec.crc, &stop_requested)) {
+      // A file that cannot be read must not cost its entry
+      complete &= !stop_requested;
+      continue;
+    }
+    hashed++;
+
+    xSemaphoreTake(index_lock, portMAX_DELAY);
+    if (record_put(&rec) && ++unsaved >= HASH_SAVE_EVERY)
+      index_save();
+    xSemaphoreGive(index_lock);
+  }
+  f_closedir(&dir);
+
+  if (complete)
+    index_prune(dir_hash, seen, seen_count);
+  free(seen);
+
+  xSemaphoreTake(index_lock, portMAX_DELAY);
+  if (unsaved)
+    index_save();
+  xSemaphoreGive(index_lock);
+
+  ESP_LOGI(TAG, "%s: %d hashed, %d known", req->path, hashed,
+           seen_count - hashed);
+}
+
+static void indexer_task(void *arg) {
+  folder_request req;
+  while (!stop_requested) {
+    if (xQueueReceive(folder_queue, &req, portMAX_DELAY) != pdTRUE)
+      continue;
+    if (req.path)
+      index_folder(&req);
+    free(req.path);
+    free(req.extension);
+  }
+  xSemaphoreGive(indexer_done);
+  vTaskDelete(NULL);
+}
+
+esp_err_t rom_hash_init(const char *path) {
+  if (indexer_handle)
+    return ESP_OK;
+
+  if (!index_lock) {
+    index_lock = xSemaphoreCreateMutex();
+    indexer_done = xSemaphoreCreateBinary();
+    folder_queue = xQueueCreate(HASH_QUEUE_DEPTH, sizeof(folder_request));
+    if (!index_lock || !indexer_done || !folder_queue)
+      return ESP_ERR_NO_MEM;
+  }
+
+  if (!index_path) {
+    if (!(index_path = strdup(path)))
+      return ESP_ERR_NO_MEM;
+    index_load();
+  }
+
+  // Lowest priority: hashing only uses time nothing else wants
+  stop_requested = false;
+  if (xTaskCreatePinnedToCore(indexer_task, "rom_hash", 4096, NULL, 1,
+                              &indexer_handle, 0) != pdPASS) {
+    indexer_handle = NULL;
+    return ESP_ERR_NO_MEM;
+  }
+  return ESP_OK;
+}
+
+esp_err_t rom_hash_index_folder(const char *path, const char *extension) {
+  if (!indexer_handle)
+    return ESP_ERR_INVALID_STATE;
+
+  folder_request req = {strdup(path), strdup(extension ? extension : "")};
+  if (!req.path || !req.extension) {
+    free(req.path);
+    free(req.extension);
+    return ESP_ERR_NO_MEM;
+  }
+
+  size_t len = strlen(req.path);
+  if (len > 1 && req.path[len - 1] == '/')
+    req.path[len - 1] = '\0';
+
+  if (xQueueSend(folder_queue, &req, 0) != pdTRUE) {
+    free(req.path);
+    free(req.extension);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+esp_err_t rom_hash_get(const char *path, uint32_t *crc) {
+  if (!index_lock || !index_path)
+    return ESP_ERR_INVALID_STATE;
+
+  char fatfs_path[HASH_PATH_MAX];
+  FILINFO info;
+  if (!sdcard_fatfs_path(path, fatfs_path, sizeof(fatfs_path)) ||
+      f_stat(fatfs_path, &info) != FR_OK)
+    return ESP_ERR_NOT_FOUND;
+
+  path_key key = path_key_of(path, strlen(path));
+  uint32_t datetime = (uint32_t)info.fdate << 16 | info.ftime;
+  if (index_lookup(key, info.fsize, datetime, crc))
+    return ESP_OK;
+
+  ESP_LOGI(TAG, "%s is not indexed yet, hashing now", path);
+  if (!hash_file(path, crc, NULL))
+    return ESP_FAIL;
+
+  const char *slash = strrchr(path, '/');
+  uint64_t dir_hash = path_key_of(path, slash ? slash - path : 0).hash;
+  hash_record rec = {key.hash, dir_hash, key.len, 0,
+                     info.fsize, datetime, *crc};
+  xSemaphoreTake(index_lock, portMAX_DELAY);
+  if (record_put(&rec))
+    index_save();
+  xSemaphoreGive(index_lock);
+  return ESP_OK;
+}
+
+void rom_hash_stop() {
+  if (!indexer_handle)
+    return;
+
+  stop_requested = true;
+  folder_request wake = {NULL, NULL};
+  xQueueSendToFront(folder_queue, &wake, portMAX_DELAY);
+  xSemaphoreTake(indexer_done, portMAX_DELAY);
+  indexer_handle = NULL;
+
+  folder_request req;
+  while (xQueueReceive(folder_queue, &req, 0) == pdTRUE) {
+    free(req.path);
+    free(req.extension);
+  }
+
+  xSemaphoreTake(index_lock, portMAX_DELAY);
+  if (unsaved)
+    index_save();
+  xSemaphoreGive(index_lock);
+}
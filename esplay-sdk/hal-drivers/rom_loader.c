@@ -0,0 +1,207 @@
+#include "rom_loader.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "hal-rom-loader";
+
+#define LOADER_SECTOR 4096
+// Kconfig takes any KB count, rounded down to whole 4 KB sectors
+#define LOADER_DEFAULT_CHUNK (CONFIG_ROM_LOADER_CHUNK_KB / 4 * LOADER_SECTOR)
+#define LOADER_END -1
+
+struct rom_loader {
+  int fd;
+  uint8_t *dest;
+  size_t size;
+  size_t chunk_size;
+  uint8_t *bounce[2];
+  size_t bounce_len[2];
+  QueueHandle_t filled; // bounce index ready to copy, LOADER_END when done
+  QueueHandle_t empty;  // bounce index free for the reader
+  SemaphoreHandle_t finished;
+  rom_loader_progress_fn progress;
+  void *progress_arg;
+  volatile bool cancel;
+  volatile bool read_error;
+  size_t done;
+  esp_err_t result;
+};
+
+static void loader_reader_task(void *arg) {
+  rom_loader_handle ld = arg;
+
+  for (size_t offset = 0; offset < ld->size;) {
+    int idx;
+    xQueueReceive(ld->empty, &idx, portMAX_DELAY);
+    if (ld->cancel)
+      break;
+
+    size_t want = ld->size - offset;
+    if (want > ld->chunk_size)
+      want = ld->chunk_size;
+
+    size_t got = 0;
+    while (got < want) {
+      ssize_t n = read(ld->fd, ld->bounce[idx] + got, want - got);
+      if (n <= 0)
+        break;
+      got += n;
+    }
+    if (got != want) {
+      ld->read_error = true;
+      break;
+    }
+
+    ld->bounce_len[idx] = want;
+    xQueueSend(ld->filled, &idx, portMAX_DELAY);
+    offset += want;
+  }
+
+  close(ld->fd);
+  ld->fd = -1;
+
+  int end = LOADER_END;
+  xQueueSend(ld->filled, &end, portMAX_DELAY);
+  vTaskDelete(NULL);
+}
+
+static void loader_copier_task(void *arg) {
+  rom_loader_handle ld = arg;
+
+  while (true) {
+    int idx;
+    xQueueReceive(ld->filled, &idx, portMAX_DELAY);
+    if (idx == LOADER_END)
+      break;
+
+    if (!ld->cancel) {
+      memcpy(ld->dest + ld->done, ld->bounce[idx], ld->bounce_len[idx]);
+      ld->done += ld->bounce_len[idx];
+      if (ld->progress)
+        ld->progress(ld->done, ld->size, ld->progress_arg);
+    }
+    xQueueSend(ld->empty, &idx, portMAX_DELAY);
+  }
+
+  if (ld->cancel)
+    ld->result = ESP_ERR_NOT_FINISHED;
+  else if (ld->read_error || ld->done != ld->size)
+    ld->result = ESP_FAIL;
+  else
+    ld->result = ESP_OK;
+
+  xSemaphoreGive(ld->finished);
+  vTaskDelete(NULL);
+}
+
+static void loader_free(rom_loader_handle ld) {
+  if (ld->fd >= 0)
+    close(ld->fd);
+  if (ld->filled)
+    vQueueDelete(ld->filled);
+  if (ld->empty)
+    vQueueDelete(ld->empty);
+  if (ld->finished)
+    vSemaphoreDelete(ld->finished);
+  heap_caps_free(ld->bounce[0]);
+  heap_caps_free(ld->bounce[1]);
+  free(ld);
+}
+
+rom_loader_handle rom_loader_start(const char *path, void *dest,
+                                   size_t dest_size,
+                                   const rom_loader_config *config) {
+  rom_loader_handle ld = calloc(1, sizeof(struct rom_loader));
+  if (!ld)
+    return NULL;
+
+  ld->fd = open(path, O_RDONLY);
+  struct stat st;
+  if (ld->fd < 0 || fstat(ld->fd, &st) != 0) {
+    ESP_LOGE(TAG, "Cannot open %s", path);
+    loader_free(ld);
+    return NULL;
+  }
+
+  ld->dest = dest;
+  ld->size = (st.st_size < dest_size) ? st.st_size : dest_size;
+  ld->chunk_size = LOADER_DEFAULT_CHUNK;
+  if (config) {
+    if (config->chunk_size)
+      ld->chunk_size = (config->chunk_size + LOADER_SECTOR - 1) &
+                       ~(size_t)(LOADER_SECTOR - 1);
+    ld->progress = config->progress;
+    ld->progress_arg = config->progress_arg;
+  }
+
+  // Whole sectors into word-aligned DMA memory go straight from the card
+  for (int i = 0; i < 2; i++)
+    ld->bounce[i] = heap_caps_aligned_alloc(4, ld->chunk_size,
+                                            MALLOC_CAP_DMA |
+                                                MALLOC_CAP_INTERNAL);
+  ld->filled = xQueueCreate(3, sizeof(int));
+  ld->empty = xQueueCreate(2, sizeof(int));
+  ld->finished = xSemaphoreCreateBinary();
+  if (!ld->bounce[0] || !ld->bounce[1] || !ld->filled || !ld->empty ||
+      !ld->finished) {
+    ESP_LOGE(TAG, "Out of memory for %u byte chunks",
+             (unsigned)ld->chunk_size);
+    loader_free(ld);
+    return NULL;
+  }
+
+  for (int i = 0; i < 2; i++)
+    xQueueSend(ld->empty, &i, 0);
+
+  if (xTaskCreate(loader_copier_task, "rom_copier", 2048, ld, 4, NULL) !=
+      pdPASS) {
+    loader_free(ld);
+    return NULL;
+  }
+  if (xTaskCreate(loader_reader_task, "rom_reader", 3072, ld, 5, NULL) !=
+      pdPASS) {
+    // Let the copier finish on its own before freeing
+    ld->cancel = true;
+    int end = LOADER_END;
+    xQueueSend(ld->filled, &end, portMAX_DELAY);
+    xSemaphoreTake(ld->finished, portMAX_DELAY);
+    loader_free(ld);
+    return NULL;
+  }
+
+  return ld;
+}
+
+esp_err_t rom_loader_wait(rom_loader_handle ld, uint32_t timeout_ms,
+                          size_t *loaded) {
+  TickType_t ticks =
+      (timeout_ms == UINT32_MAX) ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+  if (xSemaphoreTake(ld->finished, ticks) != pdTRUE)
+    return ESP_ERR_TIMEOUT;
+  xSemaphoreGive(ld->finished);
+
+  if (loaded)
+    *loaded = ld->done;
+  return ld->result;
+}
+
+void rom_loader_cancel(rom_loader_handle ld) { ld->cancel = true; }
+
+void rom_loader_close(rom_loader_handle ld) {
+  if (!ld)
+    return;
+  ld->cancel = true;
+  xSemaphoreTake(ld->finished, portMAX_DELAY);
+  loader_free(ld);
+}
@@ -0,0 +1,366 @@
+#include "save_service.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "hal-save";
+
+#define SAVE_MAX_PENDING 4
+#define SAVE_COALESCE_MS 500 // quiet time after the last request
+#define SAVE_MAX_DELAY_MS 3000 // upper bound from the first request
+#define SAVE_IDLE_BIT BIT0
+#define SAVE_SLOT_FREE_BIT BIT1
+#define SAVE_MAX_CLAIMS 8 // paths with a write or a recovery in progress
+#define SAVE_CLAIM_POLL_MS 10
+
+typedef struct {
+  char *path;
+  void *data;
+  size_t size;
+  TickType_t first_request;
+  TickType_t last_request;
+} save_request;
+
+static save_request pending[SAVE_MAX_PENDING];
+static SemaphoreHandle_t save_lock = NULL;
+static EventGroupHandle_t save_events = NULL;
+static TaskHandle_t save_task_handle = NULL;
+static volatile bool flush_requested = false;
+static volatile bool slot_wanted = false; // all slots taken, write the oldest
+static const char *writing_path = NULL;   // job being written, under save_lock
+
+// Temp files belong to whoever claimed the path, a writer between
+// save_service_open() and commit or abort, or a running recovery
+static portMUX_TYPE claim_lock = portMUX_INITIALIZER_UNLOCKED;
+static char *claimed[SAVE_MAX_CLAIMS];
+
+static bool path_exists(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0;
+}
+
+static char *path_with(const char *path, const char *suffix) {
+  char *out;
+  return asprintf(&out, "%s%s", path, suffix) < 0 ? NULL : out;
+}
+
+/**
+ * @brief Claim path, waiting out another holder when wait is set
+ */
+static bool path_claim(const char *path, bool wait) {
+  char *copy = strdup(path);
+  if (!copy)
+    return false;
+
+  while (true) {
+    bool taken = false;
+    int slot = -1;
+    taskENTER_CRITICAL(&claim_lock);
+    for (int i = 0; i < SAVE_MAX_CLAIMS; i++) {
+      if (!claimed[i])
+        slot = slot < 0 ? i : slot;
+      else if (strcmp(claimed[i], path) == 0)
+        taken = true;
+    }
+    if (!taken && slot >= 0)
+      claimed[slot] = copy;
+    taskEXIT_CRITICAL(&claim_lock);
+
+    if (!taken && slot >= 0)
+      return true;
+    if (!wait) {
+      free(copy);
+      return false;
+    }
+    vTaskDelay(pdMS_TO_TICKS(SAVE_CLAIM_POLL_MS));
+  }
+}
+
+static void path_release(const char *path) {
+  char *copy = NULL;
+  taskENTER_CRITICAL(&claim_lock);
+  for (int i = 0; i < SAVE_MAX_CLAIMS; i++) {
+    if (claimed[i] && strcmp(claimed[i], path) == 0) {
+      copy = claimed[i];
+      claimed[i] = NULL;
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&claim_lock);
+  free(copy);
+}
+
+FILE *save_service_open(const char *path) {
+  char *tmp_path = path_with(path, ".tmp");
+  if (!tmp_path || !path_claim(path, true)) {
+    free(tmp_path);
+    return NULL;
+  }
+  FILE *f = fopen(tmp_path, "wb");
+  if (!f)
+    path_release(path);
+  free(tmp_path);
+  return f;
+}
+
+bool save_service_commit(FILE *f, const char *path) {
+  bool ok = !ferror(f);
+  ok &= fflush(f) == 0;
+  ok &= fsync(fileno(f)) == 0;
+  ok &= fclose(f) == 0;
+
+  char *tmp_path = path_with(path, ".tmp");
+  char *new_path = path_with(path, ".new");
+  ok &= tmp_path && new_path;
+
+  // Only a complete, synced file is ever named .new, so that is the one
+  // save_service_recover() may promote after a cut
+  if (ok)
+    ok = rename(tmp_path, new_path) == 0;
+  if (ok) {
+    // FAT rename does not replace, so the old file goes first
+    unlink(path);
+    ok = rename(new_path, path) == 0;
+  } else if (tmp_path) {
+    unlink(tmp_path);
+  }
+
+  free(tmp_path);
+  free(new_path);
+  path_release(path);
+  return ok;
+}
+
+void save_service_abort(FILE *f, const char *path) {
+  fclose(f);
+  char *tmp_path = path_with(path, ".tmp");
+  if (tmp_path)
+    unlink(tmp_path);
+  free(tmp_path);
+  path_release(path);
+}
+
+static bool save_write(const save_request *req) {
+  FILE *f = save_service_open(req->path);
+  if (!f)
+    return false;
+  if (req->size && fwrite(req->data, 1, req->size, f) != req->size) {
+    save_service_abort(f, req->path);
+    return false;
+  }
+  return save_service_commit(f, req->path);
+}
+
+static bool request_due(const save_request *req, TickType_t now,
+                        TickType_t *wait) {
+  TickType_t quiet = req->last_request + pdMS_TO_TICKS(SAVE_COALESCE_MS);
+  TickType_t limit = req->first_request + pdMS_TO_TICKS(SAVE_MAX_DELAY_MS);
+  TickType_t due = ((int32_t)(quiet - limit) < 0) ? quiet : limit;
+  if (flush_requested || (int32_t)(now - due) >= 0)
+    return true;
+  if (due - now < *wait)
+    *wait = due - now;
+  return false;
+}
+
+static void save_task(void *arg) {
+  while (true) {
+    TickType_t wait = portMAX_DELAY;
+    save_request job = {0};
+
+    xSemaphoreTake(save_lock, portMAX_DELAY);
+    TickType_t now = xTaskGetTickCount();
+    int take = -1;
+    bool any = false;
+    for (int i = 0; i < SAVE_MAX_PENDING; i++) {
+      if (!pending[i].path)
+        continue;
+      any = true;
+      if (slot_wanted) {
+        if (take < 0 || (int32_t)(pending[i].first_request -
+                                  pending[take].first_request) < 0)
+          take = i;
+      } else if (take < 0 && request_due(&pending[i], now, &wait)) {
+        take = i;
+      }
+    }
+    if (take >= 0) {
+      // Take ownership, a new request for this path starts a new entry
+      job = pending[take];
+      writing_path = job.path;
+      memset(&pending[take], 0, sizeof(save_request));
+      slot_wanted = false;
+      xEventGroupSetBits(save_events, SAVE_SLOT_FREE_BIT);
+    }
+    if (!any) {
+      flush_requested = false;
+      xEventGroupSetBits(save_events, SAVE_IDLE_BIT);
+    }
+    xSemaphoreGive(save_lock);
+
+    if (job.path) {
+      TickType_t start = xTaskGetTickCount();
+      if (save_write(&job))
+        ESP_LOGI(TAG, "Saved %s (%u bytes) in %lu ms", job.path,
+                 (unsigned)job.size,
+                 (unsigned long)((xTaskGetTickCount() - start) *
+                                 portTICK_PERIOD_MS));
+      else
+        ESP_LOGE(TAG, "Saving %s failed", job.path);
+      xSemaphoreTake(save_lock, portMAX_DELAY);
+      writing_path = NULL;
+      xSemaphoreGive(save_lock);
+      free(job.path);
+      free(job.data);
+      continue;
+    }
+
+    ulTaskNotifyTake(pdTRUE, wait);
+  }
+}
+
+esp_err_t save_service_init() {
+  if (save_task_handle)
+    return ESP_OK;
+
+  save_lock = xSemaphoreCreateMutex();
+  save_events = xEventGroupCreate();
+  if (!save_lock || !save_events)
+    return ESP_ERR_NO_MEM;
+  xEventGroupSetBits(save_events, SAVE_IDLE_BIT);
+
+  // Lowest priority: SD writes only use time the emulator leaves idle
+  if (xTaskCreatePinnedToCore(save_task, "save", 3072, NULL, 1,
+                              &save_task_handle, 0) != pdPASS)
+    return ESP_ERR_NO_MEM;
+  return ESP_OK;
+}
+
+/**
+ * @brief Pending entry for path, or a free one. Called with save_lock held;
+ * when every entry belongs to another path, has the task write the oldest
+ * and waits for it, so it may release and retake the lock.
+ */
+static save_request *request_slot(const char *path) {
+  while (true) {
+    for (int i = 0; i < SAVE_MAX_PENDING; i++)
+      if (pending[i].path && strcmp(pending[i].path, path) == 0)
+        return &pending[i];
+    for (int i = 0; i < SAVE_MAX_PENDING; i++)
+      if (!pending[i].path)
+        return &pending[i];
+
+    slot_wanted = true;
+    xEventGroupClearBits(save_events, SAVE_SLOT_FREE_BIT);
+    xSemaphoreGive(save_lock);
+    xTaskNotifyGive(save_task_handle);
+    xEventGroupWaitBits(save_events, SAVE_SLOT_FREE_BIT, pdFALSE, pdTRUE,
+                        portMAX_DELAY);
+    xSemaphoreTake(save_lock, portMAX_DELAY);
+  }
+}
+
+esp_err_t save_service_request(const char *path, const void *data,
+                               size_t size) {
+  if (!save_task_handle)
+    return ESP_ERR_INVALID_STATE;
+
+  // An empty save is still written, as an empty file
+  void *copy = NULL;
+  if (size) {
+    copy = malloc(size);
+    if (!copy)
+      return ESP_ERR_NO_MEM;
+    memcpy(copy, data, size);
+  }
+
+  xSemaphoreTake(save_lock, portMAX_DELAY);
+  TickType_t now = xTaskGetTickCount();
+  save_request *slot = request_slot(path);
+
+  if (slot->path) {
+    // Coalesce: only the newest contents get written
+    free(slot->data);
+  } else {
+    slot->path = strdup(path);
+    slot->first_request = now;
+  }
+
+  if (!slot->path) {
+    xSemaphoreGive(save_lock);
+    free(copy);
+    return ESP_ERR_NO_MEM;
+  }
+
+  slot->data = copy;
+  slot->size = size;
+  slot->last_request = now;
+  xEventGroupClearBits(save_events, SAVE_IDLE_BIT);
+  xSemaphoreGive(save_lock);
+
+  xTaskNotifyGive(save_task_handle);
+  return ESP_OK;
+}
+
+esp_err_t save_service_flush(uint32_t timeout_ms) {
+  if (!save_task_handle)
+    return ESP_OK;
+
+  flush_requested = true;
+  xTaskNotifyGive(save_task_handle);
+  EventBits_t bits =
+      xEventGroupWaitBits(save_events, SAVE_IDLE_BIT, pdFALSE, pdTRUE,
+                          (timeout_ms == UINT32_MAX)
+                              ? portMAX_DELAY
+                              : pdMS_TO_TICKS(timeout_ms));
+  return (bits & SAVE_IDLE_BIT) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief True if path is queued or being written. Caller holds save_lock.
+ */
+static bool path_pending(const char *path) {
+  if (writing_path && strcmp(writing_path, path) == 0)
+    return true;
+  for (int i = 0; i < SAVE_MAX_PENDING; i++)
+    if (pending[i].path && strcmp(pending[i].path, path) == 0)
+      return true;
+  return false;
+}
+
+bool save_service_recover(const char *path) {
+  // A queued or running save of path lands first, it is the newest data
+  if (save_task_handle) {
+    xSemaphoreTake(save_lock, portMAX_DELAY);
+    bool busy = path_pending(path);
+    xSemaphoreGive(save_lock);
+    if (busy)
+      save_service_flush(UINT32_MAX);
+  }
+
+  // Another task writing path owns its temp files
+  if (!path_claim(path, false))
+    return path_exists(path);
+
+  char *tmp_path = path_with(path, ".tmp");
+  char *new_path = path_with(path, ".new");
+  if (tmp_path)
+    unlink(tmp_path); // never known to be complete
+  if (new_path && path_exists(new_path)) {
+    // Cut between the two renames of a commit, .new is complete
+    ESP_LOGW(TAG, "Recovering %s", path);
+    unlink(path);
+    rename(new_path, path);
+  }
+  free(tmp_path);
+  free(new_path);
+  path_release(path);
+  return path_exists(path);
+}
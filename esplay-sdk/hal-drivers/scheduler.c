@@ -0,0 +1,203 @@
+#include "scheduler.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+static const char *TAG = "scheduler";
+
+#define SCHEDULER_MAX_JOBS 8
+#define WHEEL_SLOTS 64 // power of two
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define SCHEDULER_STACK_SIZE 4096
+
+typedef enum { JOB_FREE = 0, JOB_ACTIVE, JOB_CANCELLED } job_state;
+
+struct scheduler_job {
+  job_state state;
+  bool running;
+  const char *name;
+  scheduler_job_fn fn;
+  void *arg;
+  TickType_t period;
+  TickType_t deadline;
+  TickType_t expires;
+  uint32_t misses;
+  struct scheduler_job *next;
+};
+
+static struct scheduler_job jobs[SCHEDULER_MAX_JOBS];
+static struct scheduler_job *wheel[WHEEL_SLOTS];
+static TickType_t wheel_now;
+static TaskHandle_t scheduler_task_handle = NULL;
+static portMUX_TYPE scheduler_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static TickType_t ms_to_ticks(uint32_t ms) {
+  TickType_t ticks = pdMS_TO_TICKS(ms);
+  return ticks ? ticks : 1;
+}
+
+// Caller holds scheduler_lock
+static void wheel_insert(struct scheduler_job *job) {
+  struct scheduler_job **slot = &wheel[job->expires & WHEEL_MASK];
+  job->next = *slot;
+  *slot = job;
+}
+
+/**
+ * @brief Run every job in the slot for tick t, re-arm the periodic ones
+ */
+static void wheel_process(TickType_t t) {
+  taskENTER_CRITICAL(&scheduler_lock);
+  struct scheduler_job *list = wheel[t & WHEEL_MASK];
+  wheel[t & WHEEL_MASK] = NULL;
+  taskEXIT_CRITICAL(&scheduler_lock);
+
+  while (list) {
+    struct scheduler_job *job = list;
+    list = job->next;
+
+    taskENTER_CRITICAL(&scheduler_lock);
+    bool due = job->state == JOB_ACTIVE && job->expires == t;
+    if (job->state == JOB_CANCELLED) {
+      job->state = JOB_FREE;
+    } else if (!due) {
+      // Not this lap of the wheel
+      wheel_insert(job);
+    } else {
+      job->running = true;
+    }
+    taskEXIT_CRITICAL(&scheduler_lock);
+
+    if (!due)
+      continue;
+
+    TickType_t start = xTaskGetTickCount();
+    if ((TickType_t)(start - job->expires) > job->deadline) {
+      job->misses++;
+      ESP_LOGD(TAG, "%s started %lu ticks late", job->name,
+               (unsigned long)(start - job->expires));
+    }
+
+    job->fn(job->arg);
+
+    // Skip periods that were missed entirely instead of bursting
+    TickType_t now = xTaskGetTickCount();
+    TickType_t expires = job->expires + job->period;
+    if ((int32_t)(expires - now) <= 0)
+      expires = now + 1;
+
+    taskENTER_CRITICAL(&scheduler_lock);
+    job->running = false;
+    if (job->state == JOB_CANCELLED) {
+      job->state = JOB_FREE;
+    } else {
+      job->expires = expires;
+      wheel_insert(job);
+    }
+    taskEXIT_CRITICAL(&scheduler_lock);
+  }
+}
+
+static TickType_t ticks_until_next_job(TickType_t now) {
+  TickType_t wait = portMAX_DELAY;
+
+  taskENTER_CRITICAL(&scheduler_lock);
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    if (jobs[i].state != JOB_ACTIVE)
+      continue;
+    int32_t delta = (int32_t)(jobs[i].expires - now);
+    if (delta <= 0) {
+      wait = 0;
+      break;
+    }
+    if ((TickType_t)delta < wait)
+      wait = delta;
+  }
+  taskEXIT_CRITICAL(&scheduler_lock);
+
+  return wait;
+}
+
+static void scheduler_task(void *arg) {
+  while (true) {
+    TickType_t now = xTaskGetTickCount();
+    while ((int32_t)(now - wheel_now) >= 0)
+      wheel_process(wheel_now++);
+
+    // Sleep until the next expiry; registering a job wakes us early
+    TickType_t wait = ticks_until_next_job(xTaskGetTickCount());
+    if (wait)
+      ulTaskNotifyTake(pdTRUE, wait);
+  }
+}
+
+static bool scheduler_start() {
+  if (scheduler_task_handle)
+    return true;
+
+  wheel_now = xTaskGetTickCount();
+  if (xTaskCreatePinnedToCore(&scheduler_task, "scheduler",
+                              SCHEDULER_STACK_SIZE, NULL, 5,
+                              &scheduler_task_handle, 1) != pdPASS) {
+    ESP_LOGE(TAG, "Failed to create scheduler task");
+    return false;
+  }
+  return true;
+}
+
+scheduler_job_handle scheduler_register(const char *name, scheduler_job_fn fn,
+                                        void *arg, uint32_t period_ms,
+                                        uint32_t deadline_ms) {
+  if (!fn || !scheduler_start())
+    return NULL;
+
+  struct scheduler_job *job = NULL;
+  taskENTER_CRITICAL(&scheduler_lock);
+  for (int i = 0; i < SCHEDULER_MAX_JOBS; i++) {
+    if (jobs[i].state == JOB_FREE) {
+      job = &jobs[i];
+      *job = (struct scheduler_job){
+          .state = JOB_ACTIVE,
+          .name = name,
+          .fn = fn,
+          .arg = arg,
+          .period = ms_to_ticks(period_ms),
+          .deadline = pdMS_TO_TICKS(deadline_ms),
+      };
+      job->expires = xTaskGetTickCount() + job->period;
+      wheel_insert(job);
+      break;
+    }
+  }
+  taskEXIT_CRITICAL(&scheduler_lock);
+
+  if (!job) {
+    ESP_LOGE(TAG, "No free slot for job %s", name);
+    return NULL;
+  }
+
+  xTaskNotifyGive(scheduler_task_handle);
+  return job;
+}
+
+void scheduler_unregister(scheduler_job_handle job) {
+  if (!job)
+    return;
+
+  taskENTER_CRITICAL(&scheduler_lock);
+  if (job->state == JOB_ACTIVE)
+    job->state = JOB_CANCELLED;
+  taskEXIT_CRITICAL(&scheduler_lock);
+
+  // Called from the job itself: the slot is released once it returns
+  if (xTaskGetCurrentTaskHandle() == scheduler_task_handle)
+    return;
+  while (job->running)
+    vTaskDelay(1);
+}
+
+uint32_t scheduler_deadline_misses(scheduler_job_handle job) {
+  return job ? job->misses : 0;
+}
@@ -1,11 +1,20 @@
 #include "sdcard.h"
+#include "rom_archive.h"
+#include "diskio_sdmmc.h"
 #include "driver/sdmmc_host.h"
 #include "esp_err.h"
 #include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_memory_utils.h"
+#include "esp_timer.h"
 #include "esp_vfs_fat.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "rom_loader.h"
+#include "sdcard_internal.h"
+#include "sdcard_sort.h"
 #include "sdmmc_cmd.h"
-#include <ctype.h>
 #include <dirent.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -16,58 +25,81 @@ static sdmmc_card_t *card = NULL;
 static char *mounted_path = NULL;
 static const char *TAG = "hal-sdcard";
 
-// Sorting Helpers
-static int strcicmp(char const *a, char const *b) {
-  for (;; a++, b++) {
-    int d = tolower((unsigned char)*a) - tolower((unsigned char)*b);
-    if (d != 0 || !*a)
-      return d;
-  }
-}
-
-static void quick_sort(char *arr[], int low, int high) {
-  if (low < high) {
-    char *pivot = arr[high];
-    int i = low - 1;
-    for (int j = low; j < high; j++) {
-      if (strcicmp(arr[j], pivot) < 0) {
-        i++;
-        char *tmp = arr[i];
-        arr[i] = arr[j];
-        arr[j] = tmp;
-      }
-    }
-    char *tmp = arr[i + 1];
-    arr[i + 1] = arr[high];
-    arr[high] = tmp;
-    int pi = i + 1;
-    quick_sort(arr, low, pi - 1);
-    quick_sort(arr, pi + 1, high);
-  }
-}
-
 // SD Card Logic
-esp_err_t sdcard_open(const char *base_path) {
-  if (isOpen)
-    return ESP_OK;
+#ifdef CONFIG_SDCARD_BUS_WIDTH_4
+#define SDCARD_WIDTH 4
+#else
+#define SDCARD_WIDTH 1
+#endif
+
+#ifdef CONFIG_SDCARD_HIGH_SPEED
+#define SDCARD_FREQ_KHZ SDMMC_FREQ_HIGHSPEED
+#else
+#define SDCARD_FREQ_KHZ SDMMC_FREQ_DEFAULT
+#endif
 
+static int active_width = 0;
+static int active_freq_khz = 0;
+
+// Free space. The first f_getfree() after a mount can walk the whole FAT,
+// which takes seconds on a large card, so it runs on a background task.
+// From then on FatFS keeps the count current through every write and delete
+// and f_getfree() just returns it.
+static SemaphoreHandle_t mount_lock = NULL; // held across mount and scans
+static TaskHandle_t space_task_handle = NULL;
+static bool space_known = false; // first count done, under mount_lock
+
+static void free_space_start();
+
+static esp_err_t sdcard_mount(const char *base_path, int width, int freq_khz) {
   sdmmc_host_t host = SDMMC_HOST_DEFAULT();
-  host.flags = SDMMC_HOST_FLAG_1BIT;
+  host.max_freq_khz = freq_khz;
+  if (width == 1)
+    host.flags = SDMMC_HOST_FLAG_1BIT;
 
   sdmmc_slot_config_t slot_config = SDMMC_SLOT_CONFIG_DEFAULT();
-  slot_config.width = 1;
+  slot_config.width = width;
+#ifdef CONFIG_SDCARD_INTERNAL_PULLUPS
+  slot_config.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+#endif
 
   esp_vfs_fat_sdmmc_mount_config_t mount_config = {
       .format_if_mount_failed = false,
       .max_files = 5,
       .allocation_unit_size = CONFIG_WL_SECTOR_SIZE};
 
+  if (!mount_lock && !(mount_lock = xSemaphoreCreateMutex()))
+    return ESP_ERR_NO_MEM;
+
+  xSemaphoreTake(mount_lock, portMAX_DELAY);
   esp_err_t ret = esp_vfs_fat_sdmmc_mount(base_path, &host, &slot_config,
                                           &mount_config, &card);
   if (ret == ESP_OK) {
     isOpen = true;
     mounted_path = strdup(base_path);
-    ESP_LOGI(TAG, "SDCard mounted at %s", base_path);
+    active_width = width;
+    active_freq_khz = freq_khz;
+    ESP_LOGI(TAG, "SDCard mounted at %s, %d-bit %d kHz", base_path, width,
+             freq_khz);
+  }
+  xSemaphoreGive(mount_lock);
+
+  if (ret == ESP_OK)
+    free_space_start();
+  return ret;
+}
+
+esp_err_t sdcard_open(const char *base_path) {
+  if (isOpen)
+    return ESP_OK;
+
+  esp_err_t ret = sdcard_mount(base_path, SDCARD_WIDTH, SDCARD_FREQ_KHZ);
+  if (ret != ESP_OK &&
+      (SDCARD_WIDTH != 1 || SDCARD_FREQ_KHZ != SDMMC_FREQ_DEFAULT)) {
+    // Wiring or card may not cope with the configured mode
+    ESP_LOGW(TAG, "%d-bit %d kHz mount failed (%s), falling back to 1-bit",
+             SDCARD_WIDTH, SDCARD_FREQ_KHZ, esp_err_to_name(ret));
+    ret = sdcard_mount(base_path, 1, SDMMC_FREQ_DEFAULT);
   }
   return ret;
 }
@@ -75,69 +107,310 @@ esp_err_t sdcard_open(const char *base_path) {
 esp_err_t sdcard_close() {
   if (!isOpen)
     return ESP_FAIL;
+
+  // Wait out a free space scan, it walks the FAT of this volume
+  xSemaphoreTake(mount_lock, portMAX_DELAY);
   esp_err_t ret = esp_vfs_fat_sdcard_unmount(mounted_path, card);
   if (ret == ESP_OK) {
     isOpen = false;
     free(mounted_path);
     mounted_path = NULL;
+    space_known = false;
   }
+  xSemaphoreGive(mount_lock);
   return ret;
 }
 
-void sdcard_get_free_space(uint32_t *tot, uint32_t *free_spc) {
+#define SDCARD_NAME_PATH_MAX 272 // folder plus a 255 character LFN
+
+static bool has_extension(const char *name, size_t name_len,
+                          const char *extension, size_t ext_len) {
+  return name_len > ext_len &&
+         strncasecmp(name + name_len - ext_len, extension, ext_len) == 0;
+}
+
+sdcard_name_class sdcard_name_classify(const char *name,
+                                       const char *extension) {
+  size_t name_len = strlen(name);
+  size_t ext_len = strlen(extension);
+  if (has_extension(name, name_len, extension, ext_len))
+    return SDCARD_NAME_ROM;
+
+  // "game.nes.gz" carries its extension in the name
+  if (has_extension(name, name_len, ".gz", 3))
+    return has_extension(name, name_len - 3, extension, ext_len)
+               ? SDCARD_NAME_ROM
+               : SDCARD_NAME_OTHER;
+  return has_extension(name, name_len, ".zip", 4) ? SDCARD_NAME_ZIP
+                                                  : SDCARD_NAME_OTHER;
+}
+
+bool sdcard_zip_matches(const char *dir, const char *name,
+                        const char *extension) {
+  char path[SDCARD_NAME_PATH_MAX], inner[SDCARD_NAME_PATH_MAX];
+  int len = snprintf(path, sizeof(path), "%s/%s", dir, name);
+  if (len < 0 || len >= sizeof(path) ||
+      !rom_archive_get_name(path, inner, sizeof(inner)))
+    return false;
+  return has_extension(inner, strlen(inner), extension, strlen(extension));
+}
+
+bool sdcard_name_matches(const char *dir, const char *name,
+                         const char *extension) {
+  sdcard_name_class kind = sdcard_name_classify(name, extension);
+  return kind == SDCARD_NAME_ROM ||
+         (kind == SDCARD_NAME_ZIP && sdcard_zip_matches(dir, name, extension));
+}
+
+bool sdcard_fatfs_path(const char *path, char *out, size_t out_len) {
+  if (!isOpen)
+    return false;
+
+  size_t base_len = strlen(mounted_path);
+  if (strncmp(path, mounted_path, base_len) != 0 ||
+      (path[base_len] != '/' && path[base_len] != '\0'))
+    return false;
+
+  const char *rest = path[base_len] ? path + base_len : "/";
+  int len = snprintf(out, out_len, "%d:%s", ff_diskio_get_pdrv_card(card),
+                     rest);
+  return len > 0 && len < out_len;
+}
+
+/**
+ * @brief First free cluster count of the mounted volume, which FatFS keeps
+ */
+static void free_space_scan() {
+  char drive[16];
   FATFS *fs;
-  DWORD fre_clust;
-  if (f_getfree("", &fre_clust, &fs) == FR_OK) {
-    *tot = ((fs->n_fatent - 2) * fs->csize) / 2;
-    *free_spc = (fre_clust * fs->csize) / 2;
+  DWORD free_clusters;
+
+  xSemaphoreTake(mount_lock, portMAX_DELAY);
+  if (isOpen && !space_known &&
+      sdcard_fatfs_path(mounted_path, drive, sizeof(drive))) {
+    int64_t start = esp_timer_get_time();
+    if (f_getfree(drive, &free_clusters, &fs) == FR_OK) {
+      space_known = true;
+      ESP_LOGD(TAG, "%lu free clusters, counted in %lld ms",
+               (unsigned long)free_clusters,
+               (esp_timer_get_time() - start) / 1000);
+    }
   }
+  xSemaphoreGive(mount_lock);
 }
 
-int sdcard_files_get(const char *path, const char *extension,
-                     char ***filesOut) {
-  const int MAX_FILES = 1024;
-  int count = 0;
-  char **result = malloc(MAX_FILES * sizeof(char *));
-  DIR *dir = opendir(path);
-  if (!dir || !result)
-    return 0;
+static void free_space_task(void *arg) {
+  for (;;) {
+    free_space_scan();
+    // Woken by the next mount
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+}
 
-  struct dirent *entry;
-  int ext_len = strlen(extension);
+static void free_space_start() {
+  if (space_task_handle) {
+    xTaskNotifyGive(space_task_handle);
+    return;
+  }
+
+  // Lowest priority, the first count competes with nothing the user sees
+  if (xTaskCreatePinnedToCore(free_space_task, "sd_space", 3072, NULL, 1,
+                              &space_task_handle, 0) != pdPASS)
+    ESP_LOGE(TAG, "Failed to start the free space task");
+}
+
+bool sdcard_get_free_space(uint32_t *tot, uint32_t *free_spc) {
+  // Busy means a mount, an unmount or the first count is running
+  if (!mount_lock || xSemaphoreTake(mount_lock, 0) != pdTRUE)
+    return false;
+
+  char drive[16];
+  FATFS *fs;
+  DWORD free_clusters;
+  bool known = space_known &&
+               sdcard_fatfs_path(mounted_path, drive, sizeof(drive)) &&
+               f_getfree(drive, &free_clusters, &fs) == FR_OK;
+  xSemaphoreGive(mount_lock);
+  if (!known)
+    return false;
+
+  // 512 byte sectors, reported in KiB
+  *tot = ((uint64_t)(fs->n_fatent - 2) * fs->csize) / 2;
+  *free_spc = ((uint64_t)free_clusters * fs->csize) / 2;
+  return true;
+}
+
+// Directory iterator. Names are copied into arena blocks that are never
+// moved, so every name handed out stays valid until sdcard_dir_close().
+#define DIR_ARENA_BLOCK 4096
+
+typedef struct arena_block {
+  struct arena_block *next;
+  size_t used;
+  size_t size;
+  char data[];
+} arena_block;
+
+struct sdcard_dir {
+  DIR *dir;
+  char *path;
+  char *extension;
+  int count;
+  size_t names_size;
+  arena_block *head;
+  arena_block *tail;
+};
+
+static char *arena_strdup(sdcard_dir_handle it, const char *name) {
+  size_t len = strlen(name) + 1;
+  arena_block *block = it->tail;
+  if (!block || block->size - block->used < len) {
+    size_t size = len > DIR_ARENA_BLOCK ? len : DIR_ARENA_BLOCK;
+    block = malloc(sizeof(arena_block) + size);
+    if (!block)
+      return NULL;
+    block->next = NULL;
+    block->used = 0;
+    block->size = size;
+    if (it->tail)
+      it->tail->next = block;
+    else
+      it->head = block;
+    it->tail = block;
+  }
+  char *copy = block->data + block->used;
+  memcpy(copy, name, len);
+  block->used += len;
+  return copy;
+}
 
-  while ((entry = readdir(dir)) != NULL) {
+sdcard_dir_handle sdcard_dir_open(const char *path, const char *extension) {
+  sdcard_dir_handle it = calloc(1, sizeof(struct sdcard_dir));
+  if (!it)
+    return NULL;
+
+  it->path = strdup(path);
+  it->extension = strdup(extension ? extension : "");
+  it->dir = opendir(path);
+  if (!it->path || !it->extension || !it->dir) {
+    sdcard_dir_close(it);
+    return NULL;
+  }
+  return it;
+}
+
+int sdcard_dir_next(sdcard_dir_handle it, const char **names, int max) {
+  int n = 0;
+  if (!it || !it->dir)
+    return 0;
+
+  while (n < max) {
+    struct dirent *entry = readdir(it->dir);
+    if (!entry) {
+      // Done, release the directory handle early
+      closedir(it->dir);
+      it->dir = NULL;
+      break;
+    }
     if (entry->d_name[0] == '.')
       continue;
-    int name_len = strlen(entry->d_name);
-    if (name_len <= ext_len)
+    if (!sdcard_name_matches(it->path, entry->d_name, it->extension))
       continue;
 
-    char *file_ext = &entry->d_name[name_len - ext_len];
-    if (strcasecmp(file_ext, extension) == 0) {
-      result[count] = strdup(entry->d_name);
-      if (++count >= MAX_FILES)
-        break;
+    char *name = arena_strdup(it, entry->d_name);
+    if (!name) {
+      ESP_LOGE(TAG, "Out of memory after %d entries", it->count);
+      break;
+    }
+    names[n++] = name;
+    it->count++;
+    it->names_size += strlen(name) + 1;
+  }
+  return n;
+}
+
+void sdcard_dir_close(sdcard_dir_handle it) {
+  if (!it)
+    return;
+  if (it->dir)
+    closedir(it->dir);
+  while (it->head) {
+    arena_block *next = it->head->next;
+    free(it->head);
+    it->head = next;
+  }
+  free(it->path);
+  free(it->extension);
+  free(it);
+}
+
+int sdcard_files_get(const char *path, const char *extension,
+                     char ***filesOut) {
+  *filesOut = NULL;
+  sdcard_dir_handle it = sdcard_dir_open(path, extension);
+  if (!it)
+    return 0;
+
+  const char *batch[32];
+  while (sdcard_dir_next(it, batch, 32) > 0)
+    ;
+
+  // Pointer table and names in one allocation, released with a single free
+  int count = it->count;
+  char **result = malloc(count * sizeof(char *) + it->names_size);
+  if (!result) {
+    sdcard_dir_close(it);
+    return 0;
+  }
+
+  char *names = (char *)(result + count);
+  int i = 0;
+  for (arena_block *block = it->head; block; block = block->next) {
+    for (size_t pos = 0; pos < block->used && i < count; i++) {
+      size_t len = strlen(block->data + pos) + 1;
+      memcpy(names, block->data + pos, len);
+      result[i] = names;
+      names += len;
+      pos += len;
     }
   }
-  closedir(dir);
-  if (count > 0)
-    quick_sort(result, 0, count - 1);
+  sdcard_dir_close(it);
+
+  sdcard_sort_names(result, count);
   *filesOut = result;
   return count;
 }
 
-void sdcard_files_free(char **files, int count) {
-  for (int i = 0; i < count; i++)
-    free(files[i]);
-  free(files);
-}
+void sdcard_files_free(char **files, int count) { free(files); }
 
 size_t sdcard_get_filesize(const char *path) {
+  if (rom_archive_is_archive(path))
+    return rom_archive_get_size(path);
+
   struct stat st;
   return (stat(path, &st) == 0) ? st.st_size : 0;
 }
 
 size_t sdcard_copy_file_to_memory(const char *path, void *ptr) {
+  // Callers size ptr with sdcard_get_filesize(), the uncompressed size
+  if (rom_archive_is_archive(path))
+    return rom_archive_load(path, ptr, rom_archive_get_size(path));
+
+  // PSRAM cannot take SD DMA, so reads would be bounced 512 bytes at a time.
+  // rom_loader bounces whole chunks and overlaps the copies with the reads.
+  if (!esp_ptr_dma_capable(ptr)) {
+    size_t size = sdcard_get_filesize(path);
+    rom_loader_handle ld = rom_loader_start(path, ptr, size, NULL);
+    if (ld) {
+      size_t loaded = 0;
+      esp_err_t err = rom_loader_wait(ld, UINT32_MAX, &loaded);
+      rom_loader_close(ld);
+      if (err == ESP_OK)
+        return loaded;
+    }
+    // Not enough internal RAM for the bounce buffers, or a read error
+  }
+
   FILE *f = fopen(path, "rb");
   if (!f)
     return 0;
@@ -163,3 +436,107 @@ char *sdcard_create_savefile_path(const char *base_path, const char *fileName) {
   asprintf(&path, "%s/esplay/data/%s/%s.sav", base_path, ext, fileName);
   return path;
 }
+
+#define BENCH_CHUNK (32 * 1024)
+
+static void sdcard_benchmark_run(const char *path, size_t size_kb,
+                                 sdcard_benchmark_result *result) {
+  result->write_mbps = 0.0f;
+  result->read_mbps = 0.0f;
+
+  uint8_t *buffer = heap_caps_malloc(BENCH_CHUNK, MALLOC_CAP_DMA);
+  if (!buffer) {
+    result->err = ESP_ERR_NO_MEM;
+    return;
+  }
+  for (int i = 0; i < BENCH_CHUNK; i++)
+    buffer[i] = i;
+
+  size_t total = size_kb * 1024;
+  size_t done = 0;
+  result->err = ESP_FAIL;
+
+  FILE *f = fopen(path, "wb");
+  if (f) {
+    int64_t start = esp_timer_get_time();
+    while (done < total && fwrite(buffer, 1, BENCH_CHUNK, f) == BENCH_CHUNK)
+      done += BENCH_CHUNK;
+    fsync(fileno(f));
+    fclose(f);
+    int64_t elapsed = esp_timer_get_time() - start;
+    if (done >= total && elapsed > 0)
+      result->write_mbps = (float)done / elapsed;
+  }
+
+  done = 0;
+  f = fopen(path, "rb");
+  if (f) {
+    int64_t start = esp_timer_get_time();
+    while (done < total && fread(buffer, 1, BENCH_CHUNK, f) == BENCH_CHUNK)
+      done += BENCH_CHUNK;
+    fclose(f);
+    int64_t elapsed = esp_timer_get_time() - start;
+    if (done >= total && elapsed > 0) {
+      result->read_mbps = (float)done / elapsed;
+      result->err = ESP_OK;
+    }
+  }
+
+  unlink(path);
+  free(buffer);
+}
+
+int sdcard_benchmark(size_t size_kb, sdcard_benchmark_result *results,
+                     int max_results) {
+  static const struct {
+    int width;
+    int freq_khz;
+  } modes[] = {
+      {1, SDMMC_FREQ_DEFAULT},
+      {1, SDMMC_FREQ_HIGHSPEED},
+  // DAT1-DAT3 are the status LED and a strapping pin on stock boards
+#ifdef CONFIG_SDCARD_BUS_WIDTH_4
+      {4, SDMMC_FREQ_DEFAULT},
+      {4, SDMMC_FREQ_HIGHSPEED},
+#endif
+  };
+
+  if (!isOpen)
+    return 0;
+
+  char *base_path = strdup(mounted_path);
+  char *path = NULL;
+  if (!base_path || asprintf(&path, "%s/sdbench.tmp", base_path) < 0) {
+    free(base_path);
+    return 0;
+  }
+
+  int count = 0;
+  for (int i = 0; i < sizeof(modes) / sizeof(modes[0]) && count < max_results;
+       i++) {
+    sdcard_benchmark_result *result = &results[count++];
+    result->width = modes[i].width;
+    result->freq_khz = modes[i].freq_khz;
+
+    sdcard_close();
+    result->err = sdcard_mount(base_path, modes[i].width, modes[i].freq_khz);
+    if (result->err == ESP_OK)
+      sdcard_benchmark_run(path, size_kb, result);
+
+    if (result->err == ESP_OK)
+      ESP_LOGI(TAG, "%d-bit %5d kHz: write %.2f MB/s, read %.2f MB/s",
+               result->width, result->freq_khz, result->write_mbps,
+               result->read_mbps);
+    else
+      ESP_LOGW(TAG, "%d-bit %5d kHz: %s", result->width, result->freq_khz,
+               esp_err_to_name(result->err));
+  }
+
+  // Back to the configured mode
+  sdcard_close();
+  sdcard_open(base_path);
+
+  free(path);
+  free(base_path);
+  return count;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Internal to hal-drivers: translate a path under the sdcard_open() mount
+// point into a FatFS path ("0:/roms/nes"), for code that calls FatFS
+// directly to get sizes and dates without a stat() per file.
+bool sdcard_fatfs_path(const char *path, char *out, size_t out_len);
+
+// File name filter shared by every listing: name in folder dir ends with
+// extension, or is "<name><extension>.gz", or is a .zip whose first file
+// ends with extension. Only a zip costs a file open, so callers that keep
+// results between scans classify by name first and only call
+// sdcard_zip_matches() for a zip they have not seen in its current size
+// and date.
+typedef enum {
+  SDCARD_NAME_OTHER, // not a ROM for this extension
+  SDCARD_NAME_ROM,   // matches by name alone
+  SDCARD_NAME_ZIP,   // a .zip, depends on the file inside
+} sdcard_name_class;
+
+sdcard_name_class sdcard_name_classify(const char *name,
+                                       const char *extension);
+bool sdcard_zip_matches(const char *dir, const char *name,
+                        const char *extension);
+bool sdcard_name_matches(const char *dir, const char *name,
+                         const char *extension);
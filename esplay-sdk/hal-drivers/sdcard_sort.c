@@ -0,0 +1,135 @@
+#include "sdcard_sort.h"
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SORT_KEY_LEN 8 // bytes folded into the key
+#define SORT_RUN 16    // runs sorted by insertion before merging
+
+typedef struct {
+  uint64_t key; // first SORT_KEY_LEN folded bytes, big-endian, NUL padded
+  char *name;
+} sort_entry;
+
+int sdcard_name_cmp(char const *a, char const *b) {
+  for (;; a++, b++) {
+    int d = tolower((unsigned char)*a) - tolower((unsigned char)*b);
+    if (d != 0 || !*a)
+      return d;
+  }
+}
+
+static uint64_t fold_key(const char *s) {
+  uint64_t key = 0;
+  for (int i = 0; i < SORT_KEY_LEN; i++) {
+    uint8_t c = *s ? tolower((unsigned char)*s++) : 0;
+    key = (key << 8) | c;
+  }
+  return key;
+}
+
+static inline int entry_cmp(const sort_entry *a, const sort_entry *b) {
+  if (a->key != b->key)
+    return a->key < b->key ? -1 : 1;
+  // Equal keys with a NUL inside means both names ended within the key
+  if ((a->key & 0xFF) == 0)
+    return 0;
+  return sdcard_name_cmp(a->name + SORT_KEY_LEN, b->name + SORT_KEY_LEN);
+}
+
+static void insertion_sort(sort_entry *e, int n) {
+  for (int i = 1; i < n; i++) {
+    sort_entry tmp = e[i];
+    int j = i;
+    while (j > 0 && entry_cmp(&tmp, &e[j - 1]) < 0) {
+      e[j] = e[j - 1];
+      j--;
+    }
+    e[j] = tmp;
+  }
+}
+
+static void merge(const sort_entry *src, sort_entry *dst, int lo, int mid,
+                  int hi) {
+  int i = lo, j = mid, k = lo;
+  while (i < mid && j < hi)
+    dst[k++] = (entry_cmp(&src[j], &src[i]) < 0) ? src[j++] : src[i++];
+  while (i < mid)
+    dst[k++] = src[i++];
+  while (j < hi)
+    dst[k++] = src[j++];
+}
+
+static void sift_down(char **names, int root, int count) {
+  while (2 * root + 1 < count) {
+    int child = 2 * root + 1;
+    if (child + 1 < count &&
+        sdcard_name_cmp(names[child], names[child + 1]) < 0)
+      child++;
+    if (sdcard_name_cmp(names[root], names[child]) >= 0)
+      return;
+    char *tmp = names[root];
+    names[root] = names[child];
+    names[child] = tmp;
+    root = child;
+  }
+}
+
+static void heap_sort(char **names, int count) {
+  for (int i = count / 2 - 1; i >= 0; i--)
+    sift_down(names, i, count);
+  for (int end = count - 1; end > 0; end--) {
+    char *tmp = names[0];
+    names[0] = names[end];
+    names[end] = tmp;
+    sift_down(names, 0, end);
+  }
+}
+
+void sdcard_sort_names(char **names, int count) {
+  if (count < 2)
+    return;
+
+  sort_entry *buffer = malloc(2 * count * sizeof(sort_entry));
+  if (!buffer) {
+    heap_sort(names, count);
+    return;
+  }
+
+  sort_entry *a = buffer;
+  sort_entry *b = buffer + count;
+  bool sorted = true;
+  for (int i = 0; i < count; i++) {
+    a[i].key = fold_key(names[i]);
+    a[i].name = names[i];
+    if (i > 0 && sorted && entry_cmp(&a[i - 1], &a[i]) > 0)
+      sorted = false;
+  }
+
+  // FAT folders are often already in order, nothing to do then
+  if (!sorted) {
+    for (int lo = 0; lo < count; lo += SORT_RUN)
+      insertion_sort(a + lo, (count - lo < SORT_RUN) ? count - lo : SORT_RUN);
+
+    for (int width = SORT_RUN; width < count; width *= 2) {
+      for (int lo = 0; lo < count; lo += 2 * width) {
+        int mid = (lo + width < count) ? lo + width : count;
+        int hi = (lo + 2 * width < count) ? lo + 2 * width : count;
+        if (mid == hi || entry_cmp(&a[mid - 1], &a[mid]) <= 0)
+          memcpy(b + lo, a + lo, (hi - lo) * sizeof(sort_entry));
+        else
+          merge(a, b, lo, mid, hi);
+      }
+      sort_entry *tmp = a;
+      a = b;
+      b = tmp;
+    }
+
+    for (int i = 0; i < count; i++)
+      names[i] = a[i].name;
+  }
+
+  free(buffer);
+}
@@ -0,0 +1,316 @@
+#include "thumb_atlas.h"
+#include "esp_log.h"
+#include "save_service.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static const char *TAG = "hal-thumbs";
+
+#define ATLAS_MAGIC 0x424D4854 // "THMB"
+#define ATLAS_VERSION 1
+#define ATLAS_ALIGN 512 // one sector, so slot reads skip the FatFS window
+#define ATLAS_PATH_MAX 272
+
+// On-disk layout: header, capacity index entries (the first count used,
+// sorted by name_hash), padding to data_offset, then the image slots
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entry_size;
+  uint16_t width;
+  uint16_t height;
+  uint32_t count;
+  uint32_t capacity;
+  uint32_t slot_size;   // image bytes rounded up to ATLAS_ALIGN
+  uint32_t data_offset; // first slot, a multiple of ATLAS_ALIGN
+} atlas_header;
+
+typedef struct {
+  uint32_t name_hash;
+  uint32_t slot;
+} atlas_entry;
+
+struct thumb_atlas {
+  FILE *file;
+  atlas_header header;
+  atlas_entry *entries;
+};
+
+struct thumb_atlas_writer {
+  FILE *file;
+  char path[ATLAS_PATH_MAX];
+  atlas_header header;
+  atlas_entry *entries;
+  uint8_t *slot;
+};
+
+/**
+ * @brief FNV-1a of the ROM name without folders and extension, case folded
+ */
+static uint32_t name_hash(const char *name) {
+  const char *slash = strrchr(name, '/');
+  if (slash)
+    name = slash + 1;
+
+  size_t len = strlen(name);
+  if (len > 3 && strcasecmp(name + len - 3, ".gz") == 0)
+    len -= 3;
+  for (size_t i = len; i > 0; i--) {
+    if (name[i - 1] == '.') {
+      len = i - 1;
+      break;
+    }
+  }
+
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)tolower((unsigned char)name[i]);
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static size_t image_bytes(const atlas_header *header) {
+  return (size_t)header->width * header->height * 2;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+  uint32_t x = ((const atlas_entry *)a)->name_hash;
+  uint32_t y = ((const atlas_entry *)b)->name_hash;
+  return x < y ? -1 : x > y;
+}
+
+static const atlas_entry *atlas_find(thumb_atlas_handle atlas,
+                                     const char *rom_name) {
+  if (!atlas)
+    return NULL;
+  atlas_entry key = {.name_hash = name_hash(rom_name)};
+  return bsearch(&key, atlas->entries, atlas->header.count,
+                 sizeof(atlas_entry), entry_cmp);
+}
+
+thumb_atlas_handle thumb_atlas_open(const char *path) {
+  if (!save_service_recover(path))
+    return NULL;
+  thumb_atlas_handle atlas = calloc(1, sizeof(struct thumb_atlas));
+  if (!atlas)
+    return NULL;
+
+  atlas->file = fopen(path, "rb");
+  if (!atlas->file) {
+    free(atlas);
+    return NULL;
+  }
+  // Slot reads go straight from FatFS into the caller's buffer
+  setvbuf(atlas->file, NULL, _IONBF, 0);
+
+  atlas_header *header = &atlas->header;
+  bool ok = fread(header, sizeof(*header), 1, atlas->file) == 1 &&
+            header->magic == ATLAS_MAGIC &&
+            header->version == ATLAS_VERSION &&
+            header->entry_size == sizeof(atlas_entry) &&
+            header->count <= header->capacity &&
+            header->slot_size >= image_bytes(header);
+  if (ok && header->count) {
+    atlas->entries = malloc(header->count * sizeof(atlas_entry));
+    ok = atlas->entries &&
+         fread(atlas->entries, sizeof(atlas_entry), header->count,
+               atlas->file) == header->count;
+  }
+
+  if (!ok) {
+    ESP_LOGW(TAG, "%s is not a thumbnail atlas", path);
+    thumb_atlas_close(atlas);
+    return NULL;
+  }
+  ESP_LOGI(TAG, "%s: %u thumbnails of %ux%u", path, (unsigned)header->count,
+           header->width, header->height);
+  return atlas;
+}
+
+size_t thumb_atlas_image_size(thumb_atlas_handle atlas, uint16_t *width,
+                              uint16_t *height) {
+  if (width)
+    *width = atlas->header.width;
+  if (height)
+    *height = atlas->header.height;
+  return image_bytes(&atlas->header);
+}
+
+bool thumb_atlas_contains(thumb_atlas_handle atlas, const char *rom_name) {
+  return atlas_find(atlas, rom_name) != NULL;
+}
+
+bool thumb_atlas_read(thumb_atlas_handle atlas, const char *rom_name,
+                      void *pixels) {
+  const atlas_entry *entry = atlas_find(atlas, rom_name);
+  if (!entry)
+    return false;
+
+  const atlas_header *header = &atlas->header;
+  long offset = header->data_offset + (long)entry->slot * header->slot_size;
+  size_t size = image_bytes(header);
+  return fseek(atlas->file, offset, SEEK_SET) == 0 &&
+         fread(pixels, 1, size, atlas->file) == size;
+}
+
+void thumb_atlas_close(thumb_atlas_handle atlas) {
+  if (!atlas)
+    return;
+  if (atlas->file)
+    fclose(atlas->file);
+  free(atlas->entries);
+  free(atlas);
+}
+
+static void writer_free(thumb_atlas_writer_handle writer) {
+  if (writer->file)
+    save_service_abort(writer->file, writer->path);
+  free(writer->entries);
+  free(writer->slot);
+  free(writer);
+}
+
+thumb_atlas_writer_handle thumb_atlas_create(const char *path, uint16_t width,
+                                             uint16_t height,
+                                             uint32_t capacity) {
+  if (!width || !height || !capacity)
+    return NULL;
+
+  thumb_atlas_writer_handle writer =
+      calloc(1, sizeof(struct thumb_atlas_writer));
+  if (!writer)
+    return NULL;
+
+  atlas_header *header = &writer->header;
+  *header = (atlas_header){
+      .magic = ATLAS_MAGIC,
+      .version = ATLAS_VERSION,
+      .entry_size = sizeof(atlas_entry),
+      .width = width,
+      .height = height,
+      .capacity = capacity,
+  };
+  header->slot_size =
+      (image_bytes(header) + ATLAS_ALIGN - 1) / ATLAS_ALIGN * ATLAS_ALIGN;
+  header->data_offset =
+      (sizeof(atlas_header) + capacity * sizeof(atlas_entry) + ATLAS_ALIGN -
+       1) /
+      ATLAS_ALIGN * ATLAS_ALIGN;
+
+  snprintf(writer->path, sizeof(writer->path), "%s", path);
+  writer->entries = calloc(capacity, sizeof(atlas_entry));
+  writer->slot = calloc(1, header->slot_size);
+  if (!writer->entries || !writer->slot ||
+      !(writer->file = save_service_open(writer->path))) {
+    writer_free(writer);
+    return NULL;
+  }
+
+  // Zeroed header and index for now, filled in by thumb_atlas_finish()
+  bool ok = true;
+  for (uint32_t pos = 0; ok && pos < header->data_offset;
+       pos += header->slot_size) {
+    size_t n = header->data_offset - pos;
+    if (n > header->slot_size)
+      n = header->slot_size;
+    ok = fwrite(writer->slot, 1, n, writer->file) == n;
+  }
+  if (!ok) {
+    writer_free(writer);
+    return NULL;
+  }
+  return writer;
+}
+
+/**
+ * @brief Box filter src down (or nearest up) into slot, big-endian RGB565
+ */
+static void scale_into(uint8_t *slot, uint16_t width, uint16_t height,
+                       const uint16_t *src, uint16_t src_width,
+                       uint16_t src_height) {
+  for (int y = 0; y < height; y++) {
+    int y0 = y * src_height / height;
+    int y1 = (y + 1) * src_height / height;
+    if (y1 <= y0)
+      y1 = y0 + 1;
+
+    for (int x = 0; x < width; x++) {
+      int x0 = x * src_width / width;
+      int x1 = (x + 1) * src_width / width;
+      if (x1 <= x0)
+        x1 = x0 + 1;
+
+      uint32_t r = 0, g = 0, b = 0, n = 0;
+      for (int sy = y0; sy < y1; sy++) {
+        const uint16_t *row = src + sy * src_width;
+        for (int sx = x0; sx < x1; sx++, n++) {
+          r += row[sx] >> 11;
+          g += (row[sx] >> 5) & 0x3F;
+          b += row[sx] & 0x1F;
+        }
+      }
+      uint16_t pixel = ((r / n) << 11) | ((g / n) << 5) | (b / n);
+      *slot++ = pixel >> 8;
+      *slot++ = pixel & 0xFF;
+    }
+  }
+}
+
+esp_err_t thumb_atlas_add(thumb_atlas_writer_handle writer,
+                          const char *rom_name, const uint16_t *pixels,
+                          uint16_t src_width, uint16_t src_height) {
+  atlas_header *header = &writer->header;
+  if (!pixels || !src_width || !src_height)
+    return ESP_ERR_INVALID_ARG;
+  if (header->count == header->capacity)
+    return ESP_ERR_NO_MEM;
+
+  scale_into(writer->slot, header->width, header->height, pixels, src_width,
+             src_height);
+  if (fwrite(writer->slot, 1, header->slot_size, writer->file) !=
+      header->slot_size)
+    return ESP_FAIL;
+
+  writer->entries[header->count] = (atlas_entry){
+      .name_hash = name_hash(rom_name),
+      .slot = header->count,
+  };
+  header->count++;
+  return ESP_OK;
+}
+
+esp_err_t thumb_atlas_finish(thumb_atlas_writer_handle writer) {
+  atlas_header *header = &writer->header;
+  qsort(writer->entries, header->count, sizeof(atlas_entry), entry_cmp);
+
+  // Two names with one hash: the first added keeps the entry
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < header->count; i++) {
+    if (kept && writer->entries[kept - 1].name_hash ==
+                    writer->entries[i].name_hash) {
+      ESP_LOGW(TAG, "Two thumbnails share name hash %08lx, one dropped",
+               (unsigned long)writer->entries[i].name_hash);
+      if (writer->entries[i].slot < writer->entries[kept - 1].slot)
+        writer->entries[kept - 1] = writer->entries[i];
+      continue;
+    }
+    writer->entries[kept++] = writer->entries[i];
+  }
+  header->count = kept;
+
+  bool ok = fseek(writer->file, 0, SEEK_SET) == 0 &&
+            fwrite(header, sizeof(*header), 1, writer->file) == 1 &&
+            fwrite(writer->entries, sizeof(atlas_entry), kept, writer->file) ==
+                kept;
+  if (ok) {
+    ok = save_service_commit(writer->file, writer->path);
+    writer->file = NULL;
+  }
+
+  writer_free(writer);
+  return ok ? ESP_OK : ESP_FAIL;
+}
@@ -19,6 +19,8 @@
 #include "uri_encode.h"
 #include "appfs.h"
 #include "file_server.h"
+#include "power.h"
+#include "sdcard.h"
 
 /* Max length a file path can have on storage */
 #if defined(CONFIG_FATFS_MAX_LFN)
@@ -46,21 +48,8 @@ static const char *TAG = "file_server";
 
 static bool SD_getFreeSpace(uint32_t *tot, uint32_t *free)
 {
-    FATFS *fs;
-    DWORD fre_clust, fre_sect, tot_sect;
-
-    /* Updated f_getfree for newer FatFS versions used in IDF 5.x */
-    if (f_getfree("0:", &fre_clust, &fs) == FR_OK)
-    {
-        tot_sect = (fs->n_fatent - 2) * fs->csize;
-        fre_sect = fre_clust * fs->csize;
-
-        /* Assuming 512 bytes per sector, converting to KiB */
-        *tot = tot_sect / 2;
-        *free = fre_sect / 2;
-        return true;
-    }
-    return false;
+    /* The SD driver counts in the background, the first f_getfree walks the whole FAT */
+    return sdcard_get_free_space(tot, free);
 }
 
 static int is_regular_file(const char *path)
@@ -235,8 +224,10 @@ static esp_err_t http_resp_dir_html(httpd_req_t *req, const char *dirpath)
         closedir(dir);
 
         httpd_resp_sendstr_chunk(req, "</tbody></table>");
-        SD_getFreeSpace(&btot, &bfree);
-        snprintf(storageSpace, sizeof(storageSpace), "Storage : %10lu/%10lu MiB available.", (unsigned long)(bfree / 1024), (unsigned long)(btot / 1024));
+        if (SD_getFreeSpace(&btot, &bfree))
+            snprintf(storageSpace, sizeof(storageSpace), "Storage : %10lu/%10lu MiB available.", (unsigned long)(bfree / 1024), (unsigned long)(btot / 1024));
+        else
+            snprintf(storageSpace, sizeof(storageSpace), "Storage : still counting free space.");
         httpd_resp_sendstr_chunk(req, storageSpace);
     }
 
@@ -285,7 +276,7 @@ static const char *get_path_from_uri(char *dest, const char *base_path, const ch
     return dest + base_pathlen;
 }
 
-static esp_err_t download_get_handler(httpd_req_t *req)
+static esp_err_t download_file(httpd_req_t *req)
 {
     char filepath[FILE_PATH_MAX];
     FILE *fd = NULL;
@@ -354,7 +345,7 @@ static esp_err_t download_get_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-static esp_err_t install_apps_handler(httpd_req_t *req)
+static esp_err_t install_app(httpd_req_t *req)
 {
     char filepath[FILE_PATH_MAX];
     FILE *fd = NULL;
@@ -437,7 +428,7 @@ static esp_err_t install_apps_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
-static esp_err_t upload_post_handler(httpd_req_t *req)
+static esp_err_t upload_file(httpd_req_t *req)
 {
     char filepath[FILE_PATH_MAX];
     struct stat file_stat;
@@ -528,6 +519,30 @@ static esp_err_t delete_post_handler(httpd_req_t *req)
     return ESP_OK;
 }
 
+/* Keep the clocks up and light sleep off while a transfer is in flight */
+static esp_err_t with_transfer_profile(httpd_req_t *req, esp_err_t (*handler)(httpd_req_t *))
+{
+    power_profile_acquire(POWER_PROFILE_TRANSFER);
+    esp_err_t ret = handler(req);
+    power_profile_release(POWER_PROFILE_TRANSFER);
+    return ret;
+}
+
+static esp_err_t download_get_handler(httpd_req_t *req)
+{
+    return with_transfer_profile(req, download_file);
+}
+
+static esp_err_t install_apps_handler(httpd_req_t *req)
+{
+    return with_transfer_profile(req, install_app);
+}
+
+static esp_err_t upload_post_handler(httpd_req_t *req)
+{
+    return with_transfer_profile(req, upload_file);
+}
+
 esp_err_t start_file_server(const char *base_path)
 {
     static struct file_server_data *server_data = NULL;
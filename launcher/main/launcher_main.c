@@ -7,12 +7,14 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 #include "appfs.h"
+#include "esp_attr.h"
 #include "esp_err.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "esp_netif.h"
 #include "esp_ota_ops.h"
+#include "esp_rom_crc.h"
 #include "esp_sleep.h"
 #include "esp_system.h"
 #include "esp_timer.h"
@@ -26,11 +28,14 @@
 #include "lvgl.h"
 #include "nvs_flash.h"
 #include "power.h"
+#include "power_telemetry.h"
 #include "sdcard.h"
 #include "sdkconfig.h"
 #include "soc/rtc_cntl_reg.h"
 #include "time.h"
+#include <stddef.h>
 #include <stdio.h>
+#include <sys/stat.h>
 
 static const char *TAG = "launcher";
 
@@ -68,9 +73,28 @@ typedef struct {
   lv_obj_t *battery_label;
   lv_obj_t *time_label;
   lv_indev_t *input_device;
+  lv_obj_t *list;
   current_page current_page;
 } ui_state_t;
 
+#define SNAPSHOT_MAGIC 0x4C534E50 // "LSNP"
+
+// Launcher screen state kept in RTC slow memory across deep sleep and app
+// launches, so the launcher comes back on the same screen and entry. Lists
+// are rebuilt from AppFS, whose table is already in RAM, so installs and
+// deletes in between are always picked up. Apps started from AppFS may
+// reuse that memory, hence the CRC.
+typedef struct {
+  uint32_t magic;
+  uint8_t page;
+  uint8_t reserved;
+  uint16_t focus_index;
+  int32_t scroll_y;
+  uint32_t crc;
+} launcher_snapshot;
+
+static RTC_NOINIT_ATTR launcher_snapshot snapshot;
+
 static esp_lcd_panel_handle_t panel_handle;
 static ui_state_t ui_state = {0};
 static void lv_create_homescreen();
@@ -81,20 +105,39 @@ static void init_system_components(void);
 static void init_lvgl_display(void);
 static void init_ui(void);
 static void run_main_loop(void);
+static void status_refresh_cb(lv_timer_t *timer);
+static void snapshot_save(void);
 #define LVGL_TICK_PERIOD_MS 2
+#define MENU_PROFILE_HOLD_MS 5000
+#define STATUS_REFRESH_PERIOD_MS 2000
+#define BACKLIGHT_ACTIVE 70
+#define BACKLIGHT_DIMMED 10
+#define IDLE_DIM_MS (CONFIG_LAUNCHER_IDLE_DIM_S * 1000)
+#define IDLE_SLEEP_MS (CONFIG_LAUNCHER_IDLE_SLEEP_S * 1000)
+#define IDLE_DEEP_SLEEP_MS (CONFIG_LAUNCHER_IDLE_DEEP_SLEEP_S * 1000)
+#define POWER_TELEMETRY_PATH "/sd/esplay/data/power.csv"
 #define REMOVE_FROM_GROUP 0
 #define ADD_TO_GROUP 1
 
+typedef enum { IDLE_ACTIVE = 0, IDLE_DIMMED } idle_level;
+
+static idle_level idle_state = IDLE_ACTIVE;
+static bool swallow_wake_press = false;
+static volatile int wifi_stations = 0;
+
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data) {
   if (event_id == WIFI_EVENT_AP_STACONNECTED) {
     wifi_event_ap_staconnected_t *event =
         (wifi_event_ap_staconnected_t *)event_data;
+    wifi_stations++;
     ESP_LOGI(TAG, "station " MACSTR " join, AID=%d", MAC2STR(event->mac),
              event->aid);
   } else if (event_id == WIFI_EVENT_AP_STADISCONNECTED) {
     wifi_event_ap_stadisconnected_t *event =
         (wifi_event_ap_stadisconnected_t *)event_data;
+    if (wifi_stations > 0)
+      wifi_stations--;
     ESP_LOGI(TAG, "station " MACSTR " leave, AID=%d, reason=%d",
              MAC2STR(event->mac), event->aid, event->reason);
   }
@@ -151,33 +194,84 @@ void wifi_init_softap(void) {
            ESPLAY_WIFI_SSID, ESPLAY_WIFI_PASS, ESPLAY_WIFI_CHANNEL);
 }
 
+static gamepad_repeat_state key_repeat;
+
+static uint32_t nav_key_to_lv(int input) {
+  switch (input) {
+  case GAMEPAD_INPUT_UP:
+    return LV_KEY_UP;
+  case GAMEPAD_INPUT_DOWN:
+    return LV_KEY_DOWN;
+  case GAMEPAD_INPUT_LEFT:
+    return LV_KEY_LEFT;
+  default:
+    return LV_KEY_RIGHT;
+  }
+}
+
 static void lv_keypad_read(lv_indev_t *indev, lv_indev_data_t *data) {
+  static uint32_t last_key = LV_KEY_ENTER;
+  static int pending_steps = 0;
+  static bool nav_pressed = false;
+
+  // Every navigation step is reported as a press followed by a release so
+  // LVGL sends one LV_EVENT_KEY per step; multi-step repeats and page jumps
+  // are drained within the same read cycle via continue_reading.
+  if (nav_pressed) {
+    nav_pressed = false;
+    data->key = last_key;
+    data->state = LV_INDEV_STATE_RELEASED;
+    data->continue_reading = pending_steps > 0;
+    return;
+  }
+  if (pending_steps > 0) {
+    pending_steps--;
+    nav_pressed = true;
+    data->key = last_key;
+    data->state = LV_INDEV_STATE_PRESSED;
+    data->continue_reading = true;
+    return;
+  }
+
   input_gamepad_state gamepad_state;
   gamepad_read(&gamepad_state);
 
-  // Default to released
-  data->state = LV_INDEV_STATE_RELEASED;
+  // The button that woke us from light sleep must not also act on the UI
+  if (swallow_wake_press) {
+    bool any_pressed = false;
+    for (int i = 0; i < GAMEPAD_INPUT_MAX; ++i)
+      any_pressed |= gamepad_state.values[i];
+    if (any_pressed) {
+      data->key = last_key;
+      data->state = LV_INDEV_STATE_RELEASED;
+      return;
+    }
+    swallow_wake_press = false;
+  }
 
-  if (gamepad_state.values[GAMEPAD_INPUT_UP] == 1) {
-    data->state = LV_INDEV_STATE_PRESSED;
-    data->key = LV_KEY_UP;
-  } else if (gamepad_state.values[GAMEPAD_INPUT_DOWN] == 1) {
-    data->state = LV_INDEV_STATE_PRESSED;
-    data->key = LV_KEY_DOWN;
-  } else if (gamepad_state.values[GAMEPAD_INPUT_LEFT] == 1) {
-    data->state = LV_INDEV_STATE_PRESSED;
-    data->key = LV_KEY_LEFT;
-  } else if (gamepad_state.values[GAMEPAD_INPUT_RIGHT] == 1) {
+  gamepad_repeat_event ev =
+      gamepad_repeat_update(&key_repeat, &gamepad_state, lv_tick_get());
+  if (ev.input >= 0) {
+    last_key = nav_key_to_lv(ev.input);
+    pending_steps = ev.steps - 1;
+    nav_pressed = true;
+    data->key = last_key;
     data->state = LV_INDEV_STATE_PRESSED;
-    data->key = LV_KEY_RIGHT;
-  } else if (gamepad_state.values[GAMEPAD_INPUT_B] == 1) {
+    data->continue_reading = true;
+    return;
+  }
+
+  // Action buttons are level-triggered, LVGL handles click on release
+  data->key = last_key;
+  data->state = LV_INDEV_STATE_RELEASED;
+
+  if (gamepad_state.values[GAMEPAD_INPUT_B] == 1) {
     data->state = LV_INDEV_STATE_PRESSED;
-    data->key = LV_KEY_ESC;
+    data->key = last_key = LV_KEY_ESC;
   } else if (gamepad_state.values[GAMEPAD_INPUT_A] == 1) {
     data->state = LV_INDEV_STATE_PRESSED;
-    data->key = LV_KEY_ENTER;
+    data->key = last_key = LV_KEY_ENTER;
   }
-  // No 'else' needed here as data->state is initialized to RELEASED above
 }
 
 void lvgl_flush_cb(lv_display_t *disp, const lv_area_t *area, uint8_t *px_map) {
@@ -249,8 +343,14 @@ static void lv_show_battery(void) {
                               : (bat.state == FULL_CHARGED) ? "Fully Charged"
                                                             : "Discharging";
 
-  lv_label_set_text_fmt(label, "Status\n%s\nVoltage %d mV\nPercentage %d%%",
-                        charge_status, bat.millivolts, bat.percentage);
+  if (bat.minutes_remaining >= 0)
+    lv_label_set_text_fmt(
+        label, "Status\n%s\nVoltage %d mV\nPercentage %d%%\nRemaining %dh %02dm",
+        charge_status, bat.millivolts, bat.percentage,
+        bat.minutes_remaining / 60, bat.minutes_remaining % 60);
+  else
+    lv_label_set_text_fmt(label, "Status\n%s\nVoltage %d mV\nPercentage %d%%",
+                          charge_status, bat.millivolts, bat.percentage);
 
   lv_obj_add_event_cb(mbox1, settings_mbox_event_cb, LV_EVENT_DELETE, NULL);
   lv_obj_center(mbox1);
@@ -302,7 +402,7 @@ static void lv_show_storage(void) {
   }
 
   uint32_t tot = 0, free_space = 0;
-  sdcard_get_free_space(&tot, &free_space);
+  bool counted = sdcard_get_free_space(&tot, &free_space);
 
   lv_group_remove_all_objs(ui_state.input_group);
   lv_obj_t *mbox1 = lv_msgbox_create(NULL);
@@ -323,10 +423,16 @@ static void lv_show_storage(void) {
     return;
   }
 
-  lv_label_set_text_fmt(
-      label, "SD Card\nTotal %lu MB\nFree %lu MB\n\nInternal Appfs\nFree %d KB",
-      (unsigned long)tot / 1024, (unsigned long)free_space / 1024,
-      appfsGetFreeMem() / 1024);
+  if (counted)
+    lv_label_set_text_fmt(
+        label,
+        "SD Card\nTotal %lu MB\nFree %lu MB\n\nInternal Appfs\nFree %d KB",
+        (unsigned long)tot / 1024, (unsigned long)free_space / 1024,
+        appfsGetFreeMem() / 1024);
+  else
+    lv_label_set_text_fmt(
+        label, "SD Card\nStill counting...\n\nInternal Appfs\nFree %d KB",
+        appfsGetFreeMem() / 1024);
 
   lv_obj_add_event_cb(mbox1, settings_mbox_event_cb, LV_EVENT_DELETE, NULL);
   lv_obj_center(mbox1);
@@ -371,6 +477,8 @@ static void list_items_event_handler(lv_event_t *e) {
     else {
       // App launching logic remains the same
       int fd = appfsOpen(name);
+      snapshot_save();
+      power_telemetry_stop();
       kchal_set_new_app(fd);
       esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_SLOW_MEM, ESP_PD_OPTION_ON);
       esp_sleep_enable_timer_wakeup(10);
@@ -529,6 +637,7 @@ static void lv_create_list(int type) {
   lv_obj_set_style_text_color(title, lv_palette_lighten(LV_PALETTE_GREY, 5), 0);
   lv_obj_align(title, LV_ALIGN_TOP_MID, 0, 0);
   lv_obj_t *list = lv_list_create(ui_state.screen);
+  ui_state.list = list;
   lv_obj_set_size(list, 300, 200);
   lv_obj_align(list, LV_ALIGN_TOP_MID, 0, 30);
   lv_obj_t *btn = lv_list_add_btn(list, LV_SYMBOL_LEFT, "Back");
@@ -559,13 +668,16 @@ static void init_system_components(void) {
   ESP_LOGI(TAG, "Initializing NVS flash");
   nvs_flash_init();
 
+  ESP_LOGI(TAG, "Initializing power profiles");
+  power_profiles_init();
+
   ESP_LOGI(TAG, "Initializing battery level");
   battery_level_init();
 
   ESP_LOGI(TAG, "Initializing LCD display");
 
   lcd_init(&panel_handle);
-  lcd_set_brightness(70);
+  lcd_set_brightness(BACKLIGHT_ACTIVE);
 
   ESP_LOGI(TAG, "Initializing gamepad");
   gamepad_init();
@@ -598,6 +710,7 @@ static void init_lvgl_display(void) {
   }
   lv_indev_set_type(indev, LV_INDEV_TYPE_KEYPAD);
   lv_indev_set_read_cb(indev, lv_keypad_read);
+  gamepad_repeat_init(&key_repeat, NULL);
   ui_state.input_device = indev;
 
   ESP_LOGI(TAG, "Installing LVGL tick timer");
@@ -616,53 +729,130 @@ static void init_lvgl_display(void) {
   lv_group_set_default(ui_state.input_group);
   lv_indev_set_group(ui_state.input_device, ui_state.input_group);
 
-  lv_create_homescreen();
+  // Clock and battery icon on the home screen
+  lv_timer_create(status_refresh_cb, STATUS_REFRESH_PERIOD_MS, NULL);
 }
 
 static void init_ui(void) {
   sdcard_open("/sd");
+#ifdef CONFIG_LAUNCHER_POWER_TELEMETRY
+  mkdir("/sd/esplay", 0777);
+  mkdir("/sd/esplay/data", 0777);
+  power_telemetry_start(POWER_TELEMETRY_PATH, "launcher");
+#endif
   ESP_LOGI(TAG, "ESP_WIFI_MODE_AP");
   wifi_init_softap();
   ESP_ERROR_CHECK(start_file_server("/sd"));
 }
 
+static void status_refresh_cb(lv_timer_t *timer) {
+  if (ui_state.current_page != PAGE_HOME)
+    return;
+
+  char buffer[64];
+  get_time(buffer, sizeof(buffer));
+  lv_label_set_text(ui_state.time_label, buffer);
+
+  battery_state bat;
+  battery_level_read(&bat);
+
+  if (bat.state == FULL_CHARGED || bat.state == CHARGING)
+    lv_label_set_text(ui_state.battery_label, LV_SYMBOL_CHARGE);
+  else {
+    if (bat.percentage > 75)
+      lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_FULL);
+    else if (bat.percentage > 50)
+      lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_3);
+    else if (bat.percentage > 25)
+      lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_2);
+    else if (bat.percentage > 5)
+      lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_1);
+    else
+      lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_EMPTY);
+  }
+}
+
+/**
+ * @brief Light sleep with the backlight and Wi-Fi off until a button is
+ * pressed, then deep sleep once the deep sleep timeout runs out.
+ */
+static void idle_sleep(uint32_t inactive_ms) {
+  uint32_t timeout = UINT32_MAX;
+  if (IDLE_DEEP_SLEEP_MS > 0)
+    timeout = (inactive_ms < IDLE_DEEP_SLEEP_MS)
+                  ? IDLE_DEEP_SLEEP_MS - inactive_ms
+                  : 0;
+
+  ESP_LOGI(TAG, "Idle, entering light sleep");
+  lcd_set_brightness(0);
+  esp_wifi_stop();
+
+  bool woken = system_light_sleep(timeout);
+
+  esp_wifi_start();
+  if (!woken) {
+    ESP_LOGI(TAG, "Idle timeout, entering deep sleep");
+    snapshot_save();
+    power_telemetry_stop();
+    system_sleep();
+    return;
+  }
+
+  ESP_LOGI(TAG, "Woken by input");
+  swallow_wake_press = true;
+  lv_display_trigger_activity(NULL);
+  lcd_set_brightness(BACKLIGHT_ACTIVE);
+  idle_state = IDLE_ACTIVE;
+}
+
+/**
+ * @brief Step the idle manager: dim, then light sleep, then deep sleep
+ */
+static void idle_update(uint32_t inactive_ms) {
+  if (inactive_ms < IDLE_DIM_MS) {
+    if (idle_state != IDLE_ACTIVE) {
+      lcd_set_brightness(BACKLIGHT_ACTIVE);
+      idle_state = IDLE_ACTIVE;
+    }
+    return;
+  }
+
+  if (idle_state == IDLE_ACTIVE) {
+    lcd_set_brightness(BACKLIGHT_DIMMED);
+    idle_state = IDLE_DIMMED;
+  }
+
+  // Stay dimmed but awake while someone is using the file server
+  if (power_profile_active(POWER_PROFILE_TRANSFER) || wifi_stations > 0)
+    return;
+
+  if (inactive_ms >= IDLE_SLEEP_MS)
+    idle_sleep(inactive_ms);
+}
+
 static void run_main_loop(void) {
-  TickType_t xLast = xTaskGetTickCount();
+  bool menu_profile_held = false;
   while (1) {
     // lv_timer_handler now returns the time until the next call is needed
     uint32_t time_till_next = lv_timer_handler();
 
+    // Full clock while the user navigates, idle profile once they stop
+    bool navigating = lv_display_get_inactive_time(NULL) < MENU_PROFILE_HOLD_MS;
+    if (navigating != menu_profile_held) {
+      if (navigating)
+        power_profile_acquire(POWER_PROFILE_MENU);
+      else
+        power_profile_release(POWER_PROFILE_MENU);
+      menu_profile_held = navigating;
+    }
+
+    idle_update(lv_display_get_inactive_time(NULL));
+
     // Dynamic delay based on LVGL needs, capped at 10ms for responsiveness
-    uint32_t delay = (time_till_next > 10) ? 10 : time_till_next;
+    // and relaxed to the input read period once the screen is dimmed
+    uint32_t max_delay = (idle_state == IDLE_ACTIVE) ? 10 : LV_DEF_REFR_PERIOD;
+    uint32_t delay = (time_till_next > max_delay) ? max_delay : time_till_next;
     vTaskDelay(pdMS_TO_TICKS(delay));
-
-    TickType_t xNow = xTaskGetTickCount();
-    if ((xNow - xLast) > pdMS_TO_TICKS(2000)) {
-      if (ui_state.current_page == PAGE_HOME) {
-        char buffer[64];
-        get_time(buffer, sizeof(buffer));
-        lv_label_set_text(ui_state.time_label, buffer);
-
-        battery_state bat;
-        battery_level_read(&bat);
-
-        if (bat.state == FULL_CHARGED || bat.state == CHARGING)
-          lv_label_set_text(ui_state.battery_label, LV_SYMBOL_CHARGE);
-        else {
-          if (bat.percentage > 75)
-            lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_FULL);
-          else if (bat.percentage > 50)
-            lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_3);
-          else if (bat.percentage > 25)
-            lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_2);
-          else if (bat.percentage > 5)
-            lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_1);
-          else
-            lv_label_set_text(ui_state.battery_label, LV_SYMBOL_BATTERY_EMPTY);
-        }
-      }
-      xLast = xNow;
-    }
   }
 }
 
@@ -724,6 +914,7 @@ static void lv_create_homescreen() {
   }
   lv_group_remove_all_objs(ui_state.input_group);
   lv_obj_clean(ui_state.screen);
+  ui_state.list = NULL;
 
   char buffer[64];
   get_time(buffer, sizeof(buffer));
@@ -768,9 +959,65 @@ static void lv_create_homescreen() {
   ui_state.current_page = PAGE_HOME;
 }
 
+/**
+ * @brief Record the current screen in RTC memory before deep sleep or an
+ * app launch
+ */
+static void snapshot_save(void) {
+  memset(&snapshot, 0, sizeof(snapshot));
+  snapshot.page = ui_state.current_page;
+
+  lv_obj_t *focused = lv_group_get_focused(ui_state.input_group);
+  snapshot.focus_index = focused ? lv_obj_get_index(focused) : 0;
+  snapshot.scroll_y = ui_state.list ? lv_obj_get_scroll_y(ui_state.list) : 0;
+
+  snapshot.magic = SNAPSHOT_MAGIC;
+  snapshot.crc = esp_rom_crc32_le(0, (const uint8_t *)&snapshot,
+                                  offsetof(launcher_snapshot, crc));
+}
+
+/**
+ * @brief Rebuild the screen recorded by snapshot_save(), if there is one.
+ *
+ * The snapshot is used once. If entries were removed since, the focus falls
+ * back to the list default.
+ */
+static bool snapshot_restore(void) {
+  launcher_snapshot snap = snapshot;
+  snapshot.magic = 0;
+
+  if (snap.magic != SNAPSHOT_MAGIC || snap.page > PAGE_SETTINGS ||
+      snap.crc != esp_rom_crc32_le(0, (const uint8_t *)&snap,
+                                   offsetof(launcher_snapshot, crc)))
+    return false;
+
+  ESP_LOGI(TAG, "Restoring page %d from RTC snapshot", snap.page);
+  if (snap.page == PAGE_HOME) {
+    lv_create_homescreen();
+  } else {
+    lv_create_list(snap.page - PAGE_APP + LIST_APP);
+  }
+
+  lv_obj_t *parent = ui_state.list ? ui_state.list : ui_state.screen;
+  lv_obj_t *focus = lv_obj_get_child(parent, snap.focus_index);
+  if (focus && lv_obj_get_group(focus) == ui_state.input_group)
+    lv_group_focus_obj(focus);
+
+  if (ui_state.list) {
+    lv_obj_update_layout(ui_state.list);
+    lv_obj_scroll_to_y(ui_state.list, snap.scroll_y, LV_ANIM_OFF);
+  }
+  return true;
+}
+
 void app_main(void) {
   init_system_components();
   init_lvgl_display();
+  if (!snapshot_restore())
+    lv_create_homescreen();
+
+  // Put the screen up before mounting SD and starting Wi-Fi
+  lv_refr_now(NULL);
   init_ui();
   run_main_loop();
 }